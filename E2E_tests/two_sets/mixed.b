@@ -0,0 +1,4 @@
+3
+9 9 0 12 9 0 9 12 0
+30 30 30 31 30 30 30 31 30
+20 20 20 20 20 20 20 20 20
@@ -0,0 +1,2 @@
+1
+5 5 5 6 5 5 5 6 5
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Driver
+{
+
+// Allocation accounting: src/alloc_stats.cpp replaces the global operator new and delete, so
+// it is linked only into executables (Driver, benchmark, tests), never into TrianglesAPI.
+// Nothing is counted until enable(true); counters are process-wide atomics.
+namespace Alloc
+{
+
+struct Counters
+{
+    size_t allocs = 0;  // calls of operator new
+    size_t bytes = 0;   // requested by them
+    int64_t peak = 0;   // highest growth of the heap in use over its size at reset(), in bytes
+    int64_t growth = 0; // heap in use now over its size at reset(), in bytes
+};
+
+void enable(bool on);
+
+// counters since the last reset
+Counters counters();
+void reset();
+
+// peak resident set size of the process (VmHWM) in bytes, 0 if unknown
+size_t peak_rss();
+// sets the peak to the current RSS (Linux: /proc/self/clear_refs), no-op if unsupported
+void reset_peak_rss();
+
+} // namespace Alloc
+
+} // namespace Driver
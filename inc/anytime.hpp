@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#include "driver.hpp"
+
+namespace Driver
+{
+
+// Search with a time budget: candidate pairs (shapes with intersecting bounding boxes) are tested
+// in the order of the volume of the overlap of their boxes, the biggest first, and every shape is
+// reported as soon as it is confirmed. The order comes from a best-first traversal of pairs of LBVH
+// nodes: the overlap of two nodes bounds the overlaps of all pairs below them, so candidates are
+// never enumerated in advance. Pairs of two confirmed shapes can't add anything and are skipped.
+// When the budget is over the search stops between two pairs.
+namespace Anytime
+{
+
+struct Params
+{
+    std::chrono::milliseconds budget{1000}; // from the start of the search
+};
+
+struct Report
+{
+    bool complete = false;  // all candidate pairs were checked before the deadline
+    size_t n_checked = 0;   // candidate pairs tested or skipped
+    // shapes which are not confirmed and may be in unchecked candidate pairs, in the order of indices
+    std::vector<index_t> unchecked;
+};
+
+// on_found(ind) is called for every confirmed shape once, in the order they are confirmed
+Report get_inds_with_intscs(ListPoint3D &points, ListLineSeg3D &linesegs, ListTriangle3D &triangles,
+                            const Params &params, const std::function<void(index_t)> &on_found,
+                            Stats *stats = nullptr);
+
+} // namespace Anytime
+
+} // namespace Driver
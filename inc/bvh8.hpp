@@ -0,0 +1,278 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "driver.hpp"
+#include "lbvh.hpp"
+#include "parallel.hpp"
+#include "storage.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace Driver
+{
+
+// Wide BVH: the LBVH collapsed into nodes of up to 8 children (every node takes the children of
+// its biggest internal child while there is room). A node keeps the boxes of its children as
+// separate coordinate arrays of floats rounded outwards, 4 cache lines in total, and all its
+// children are tested against a query box at once, 4 per SSE2 instruction. Float node boxes only
+// cull subtrees: leaves are tested with their own boxes, so the candidate pairs are exactly those
+// of the LBVH. Queries sent down together in packets share every node they visit: a packet of
+// PACKET consecutive leaves (close in space, as leaves are in the Morton order) loads a node once
+// for all the queries which reach it.
+class BVH8 final
+{
+public:
+    static const size_t WIDTH = 8;
+    static const size_t PACKET = 16;
+    static const size_t LEAF_RANGE = 4; // subtrees of up to so many leaves are children of nodes
+    static const uint32_t LEAF_FLAG = LBVH::LEAF_FLAG;
+    static const size_t MAX_DEPTH = LBVH::MAX_DEPTH; // collapsing the LBVH makes no level deeper
+
+    // boxes of the children by axis; empty slots are NaN and fail every comparison
+    struct alignas(64) Node
+    {
+        float min[3][WIDTH], max[3][WIDTH];
+        uint32_t child[WIDTH];     // leaves from (first | LEAF_FLAG) to last_leaf, or index of the node
+        uint32_t last_leaf[WIDTH]; // leaves of the subtree of the child end with this one
+    };
+
+    // query box rounded outwards to floats and widened by DBL_PRECISION, every coordinate
+    // repeated for the 4 lanes of a SSE2 register
+    struct QueryBox
+    {
+        alignas(16) float min[3][4], max[3][4];
+
+        QueryBox() = default;
+        explicit QueryBox(const Geom::BoundingBox &box);
+    };
+private:
+    Storage<Node> nodes_;                        // root is nodes_[0], unless there is one leaf
+    Storage<Geom::BoundingBox> leaf_boxes_;      // in the sorted order of the LBVH
+    Storage<uint32_t> leaf_items_;
+
+    // bit i is set if child i of the node may intersect the box
+    static uint32_t overlap_mask(const Node &node, const QueryBox &box);
+
+    // the traversal of one packet of queries: on_pair(query, leaf) for every leaf of this tree
+    // whose box intersects boxes[query], for query < n; with min_leaves only leaves after
+    // min_leaves[query] are reported
+    template <typename F>
+    void query_packet(const Geom::BoundingBox *boxes, size_t n, const uint32_t *min_leaves, F &&on_pair) const;
+public:
+    explicit BVH8(const std::vector<Geom::BoundingBox> &boxes) : BVH8(LBVH{boxes}) {}
+    explicit BVH8(const LBVH &bvh);
+    // the tree built before, e.g. views of the arrays of a mapped scene file
+    BVH8(Storage<Node> nodes, Storage<Geom::BoundingBox> leaf_boxes, Storage<uint32_t> leaf_items)
+        : nodes_(std::move(nodes)), leaf_boxes_(std::move(leaf_boxes)), leaf_items_(std::move(leaf_items)) {}
+
+    const Storage<Node> &nodes() const {return nodes_;};
+    const Storage<Geom::BoundingBox> &leaf_boxes() const {return leaf_boxes_;};
+    const Storage<uint32_t> &leaf_items() const {return leaf_items_;};
+
+    size_t size() const {return leaf_boxes_.size();};
+    size_t n_nodes() const {return nodes_.size();};
+    uint32_t leaf_item(size_t leaf) const {return leaf_items_[leaf];};
+    const Geom::BoundingBox &leaf_box(size_t leaf) const {return leaf_boxes_[leaf];};
+
+    // calls on_leaf(leaf) for every leaf with index >= min_leaf whose box intersects the given one
+    template <typename F>
+    void query(const Geom::BoundingBox &box, F &&on_leaf, size_t min_leaf = 0) const;
+
+    // calls on_pair(thread_id, leaf, other_leaf) for every pair of leaves with intersecting boxes,
+    // leaf < other_leaf; packets of consecutive leaves are queried in parallel
+    template <typename F>
+    void query_self_pairs(F &&on_pair) const;
+
+    // calls on_pair(thread_id, leaf, other_leaf) for every pair of a leaf of this tree and a leaf
+    // of the other one with intersecting boxes; packets of leaves of this tree query the other one
+    template <typename F>
+    void query_pairs(const BVH8 &other, F &&on_pair) const;
+};
+
+inline uint32_t BVH8::overlap_mask(const Node &node, const QueryBox &box)
+{
+    uint32_t mask = 0;
+#ifdef __SSE2__
+    for (size_t k = 0; k < WIDTH; k += 4)
+    {
+        __m128 ok = _mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.min[0] + k), _mm_load_ps(box.max[0])),
+                               _mm_cmple_ps(_mm_load_ps(box.min[0]), _mm_load_ps(node.max[0] + k)));
+        for (int axis = 1; axis < 3; axis++)
+        {
+            ok = _mm_and_ps(ok, _mm_cmple_ps(_mm_load_ps(node.min[axis] + k), _mm_load_ps(box.max[axis])));
+            ok = _mm_and_ps(ok, _mm_cmple_ps(_mm_load_ps(box.min[axis]), _mm_load_ps(node.max[axis] + k)));
+        }
+        mask |= static_cast<uint32_t>(_mm_movemask_ps(ok)) << k;
+    }
+#else
+    for (size_t i = 0; i < WIDTH; i++)
+    {
+        bool ok = true;
+        for (int axis = 0; axis < 3; axis++)
+            ok = ok && node.min[axis][i] <= box.max[axis][0] && box.min[axis][0] <= node.max[axis][i];
+        mask |= uint32_t{ok} << i;
+    }
+#endif
+    return mask;
+}
+
+template <typename F>
+void BVH8::query(const Geom::BoundingBox &box, F &&on_leaf, size_t min_leaf) const
+{
+    if (leaf_boxes_.size() <= 1)
+    {
+        if (leaf_boxes_.size() == 1 && min_leaf == 0 && leaf_boxes_[0].intersects(box))
+            on_leaf(0);
+        return;
+    }
+
+    QueryBox qbox{box};
+    // every level pushes at most WIDTH - 1 nodes above the ones of the levels before it
+    const size_t MAX_STACK = MAX_DEPTH * WIDTH;
+    uint32_t stack[MAX_STACK];
+    size_t top = 0;
+    stack[top++] = 0;
+
+    while (top)
+    {
+        const Node &node = nodes_[stack[--top]];
+        for (uint32_t mask = overlap_mask(node, qbox); mask; mask &= mask - 1)
+        {
+            size_t i = __builtin_ctz(mask);
+            if (node.last_leaf[i] < min_leaf)
+                continue;
+            uint32_t child = node.child[i];
+            if (child & LEAF_FLAG)
+            {
+                size_t first = std::max<size_t>(child & ~LEAF_FLAG, min_leaf);
+                for (size_t leaf = first; leaf <= node.last_leaf[i]; leaf++)
+                    if (leaf_boxes_[leaf].intersects(box))
+                        on_leaf(leaf);
+            }
+            else
+                stack[top++] = child;
+        }
+    }
+}
+
+template <typename F>
+void BVH8::query_packet(const Geom::BoundingBox *boxes, size_t n, const uint32_t *min_leaves, F &&on_pair) const
+{
+    // the only leaf is never after min_leaves[query]
+    if (leaf_boxes_.size() <= 1)
+    {
+        for (size_t query = 0; query < n; query++)
+            if (leaf_boxes_.size() == 1 && !min_leaves && leaf_boxes_[0].intersects(boxes[query]))
+                on_pair(query, 0);
+        return;
+    }
+
+    QueryBox qboxes[PACKET];
+    for (size_t query = 0; query < n; query++)
+        qboxes[query] = QueryBox{boxes[query]};
+
+    // nodes with the mask of the queries which reach them
+    struct Entry
+    {
+        uint32_t node, queries;
+    };
+    const size_t MAX_STACK = MAX_DEPTH * WIDTH;
+    Entry stack[MAX_STACK];
+    size_t top = 0;
+    stack[top++] = {0, static_cast<uint32_t>((uint64_t{1} << n) - 1)};
+
+    while (top)
+    {
+        Entry entry = stack[--top];
+        const Node &node = nodes_[entry.node];
+
+        // transposed: the queries which reach every child
+        uint32_t child_queries[WIDTH] = {};
+        uint32_t children = 0;
+        for (uint32_t queries = entry.queries; queries; queries &= queries - 1)
+        {
+            size_t query = __builtin_ctz(queries);
+            uint32_t mask = overlap_mask(node, qboxes[query]);
+            for (; mask; mask &= mask - 1)
+            {
+                size_t i = __builtin_ctz(mask);
+                if (!min_leaves || node.last_leaf[i] > min_leaves[query])
+                    child_queries[i] |= uint32_t{1} << query;
+            }
+        }
+        for (size_t i = 0; i < WIDTH; i++)
+            children |= uint32_t{child_queries[i] != 0} << i;
+
+        for (; children; children &= children - 1)
+        {
+            size_t i = __builtin_ctz(children);
+            uint32_t child = node.child[i];
+            if (child & LEAF_FLAG)
+                for (uint32_t queries = child_queries[i]; queries; queries &= queries - 1)
+                {
+                    size_t query = __builtin_ctz(queries);
+                    uint32_t first = child & ~LEAF_FLAG;
+                    if (min_leaves)
+                        first = std::max(first, min_leaves[query] + 1);
+                    for (uint32_t leaf = first; leaf <= node.last_leaf[i]; leaf++)
+                        if (leaf_boxes_[leaf].intersects(boxes[query]))
+                            on_pair(query, leaf);
+                }
+            else
+                stack[top++] = {child, child_queries[i]};
+        }
+    }
+}
+
+template <typename F>
+void BVH8::query_self_pairs(F &&on_pair) const
+{
+    size_t n = size();
+    // 4 packets at a time, the same 64 leaves a thread takes in the loops over LBVH queries
+    const size_t GRAIN = 4;
+    Parallel::for_each((n + PACKET - 1) / PACKET, GRAIN, [&](size_t thr, size_t packet)
+    {
+        size_t begin = packet * PACKET, cnt = std::min(n, begin + PACKET) - begin;
+        uint32_t min_leaves[PACKET];
+        for (size_t query = 0; query < cnt; query++)
+            min_leaves[query] = begin + query;
+        query_packet(&leaf_boxes_[begin], cnt, min_leaves, [&](size_t query, uint32_t leaf)
+        {
+            on_pair(thr, begin + query, leaf);
+        });
+    });
+}
+
+template <typename F>
+void BVH8::query_pairs(const BVH8 &other, F &&on_pair) const
+{
+    size_t n = size();
+    const size_t GRAIN = 4;
+    Parallel::for_each((n + PACKET - 1) / PACKET, GRAIN, [&](size_t thr, size_t packet)
+    {
+        size_t begin = packet * PACKET, cnt = std::min(n, begin + PACKET) - begin;
+        other.query_packet(&leaf_boxes_[begin], cnt, nullptr, [&](size_t query, uint32_t other_leaf)
+        {
+            on_pair(thr, begin + query, other_leaf);
+        });
+    });
+}
+
+std::set<index_t> get_inds_with_intscs_bvh8(const ShapeArray &arr, Stats *stats = nullptr,
+                                            UnionFind *components = nullptr);
+
+// the same with a tree built before over the boxes of the shapes, e.g. taken from a scene file
+std::set<index_t> get_inds_with_intscs_bvh8(const ShapeArray &arr, const BVH8 &bvh, Stats *stats = nullptr,
+                                            UnionFind *components = nullptr);
+
+// only pairs of shapes from different sets are tested, with one BVH8 per set
+void get_inds_with_cross_intscs_bvh8(const ShapeArray &a, const ShapeArray &b, std::set<index_t> &inds_a,
+                                     std::set<index_t> &inds_b, Stats *stats = nullptr,
+                                     UnionFind *components = nullptr);
+
+} // namespace Driver
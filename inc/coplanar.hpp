@@ -0,0 +1,18 @@
+#pragma once
+
+#include "driver.hpp"
+
+namespace Driver
+{
+
+// Coplanar stage: triangles are grouped by their plane (normal and offset equal on the DBL_PRECISION
+// grid and by Plane::operator==), and pairs inside every group are resolved by a 2D sweep over the
+// boxes of the triangles projected to the plane with the exact intersects_Triangle2D test.
+// The engine tests only the remaining pairs: shapes off the groups with each other and with the
+// grouped triangles; grouped triangles of different planes are tested with an LBVH which skips
+// pairs of one group (counted in Stats::pruned). Triangles are moved to the end of their list.
+std::set<index_t> get_inds_with_intscs_coplanar(ListPoint3D &points, ListLineSeg3D &linesegs,
+                                                ListTriangle3D &triangles, Engine engine,
+                                                Stats *stats = nullptr, UnionFind *components = nullptr);
+
+} // namespace Driver
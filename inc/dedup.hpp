@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include "driver.hpp"
+
+namespace Driver
+{
+
+// indices of duplicate shapes: shapes of one kind equal up to the order of their vertices after
+// rounding of the coordinates to the DBL_PRECISION grid; the representative goes first
+using DuplicateGroup = std::vector<index_t>;
+
+// leaves only the representative (the first in the list) of every group of duplicates in the lists,
+// so the engines test each group once; returns the groups with more than one shape
+std::vector<DuplicateGroup> remove_duplicates(ListPoint3D &points, ListLineSeg3D &linesegs,
+                                              ListTriangle3D &triangles);
+
+// copies the result of every representative to the rest of its group; with members_intersect
+// (the group is from the only set of shapes) all members are added, as duplicates intersect each other
+void restore_duplicates(const std::vector<DuplicateGroup> &groups, std::set<index_t> &indcs,
+                        bool members_intersect = true);
+
+} // namespace Driver
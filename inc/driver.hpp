@@ -4,23 +4,181 @@
 #include <list>
 #include <set>
 #include <iostream>
+#include <cstdint>
+#include <variant>
+#include <array>
+#include <optional>
 
 #include "triangles.hpp"
+#include "storage.hpp"
 
 namespace Driver
 {
 using index_t = size_t;
 
+class UnionFind;
+
 void get_input(std::vector<double> &out, std::istream& stream);
 
 using ListPoint3D = std::list<std::pair<index_t, Geom::Point3D>>;
 using ListLineSeg3D = std::list<std::pair<index_t, Geom::LineSeg3D>>;
 using ListTriangle3D = std::list<std::pair<index_t, Geom::Triangle3D>>;  
 
+enum class ShapeKind : uint8_t {Point, LineSeg, Triangle};
+
+// kind of the shape given by three (maybe coinciding) points; for a line segment
+// its endpoints are moved to p1 and p2
+ShapeKind classify_shape(Geom::Point3D &p1, Geom::Point3D &p2, Geom::Point3D &p3);
+
+// builds the shape given by three points (see classify_shape) and calls f with it
+template <typename F>
+decltype(auto) with_shape(Geom::Point3D p1, Geom::Point3D p2, Geom::Point3D p3, F &&f)
+{
+    switch (classify_shape(p1, p2, p3))
+    {
+    case ShapeKind::Point:   return f(p1);
+    case ShapeKind::LineSeg: return f(Geom::LineSeg3D{p1, p2});
+    default:                 return f(Geom::Triangle3D{p1, p2, p3});
+    }
+}
+
+// classifies the shape given by 9 coordinates (point, line segment or triangle)
+void parse_shape(index_t ind, const double *coords, ListPoint3D &points_out,
+                 ListLineSeg3D &linesegs_out, ListTriangle3D &triangles_out);
+
 void parse_input(ListPoint3D &points_out, ListLineSeg3D &linesegs_out,
                  ListTriangle3D &triangles_out, const std::vector<double> &inp);
 
+// the scene is split into 'count' slabs of equal width along its longest axis,
+// shard 'id' gets every shape whose bounding box touches its slab (keeping global indices);
+// the first and the last slabs reach to infinity, so shapes out of the bounds aren't lost
+struct Shard
+{
+    size_t id = 0;
+    size_t count = 1;
+    // min x, y, z and max x, y, z of the scene; found with a first pass over the input if not given
+    std::optional<std::array<double, 6>> bounds;
+};
+
+// streams the shapes of the input and keeps only those of the shard, so memory is proportional to
+// the shard; without the bounds the stream is read twice and must be seekable
+void parse_input(ListPoint3D &points_out, ListLineSeg3D &linesegs_out,
+                 ListTriangle3D &triangles_out, std::istream &stream, Shard shard);
+
+// sorts shapes of every list by the Morton code of the center of their bounding box, so that
+// shapes close in space are close in memory; indices stay attached to the shapes for output
+void reorder_morton(ListPoint3D &points, ListLineSeg3D &linesegs, ListTriangle3D &triangles);
+
+// deterministic counters of the pair tests done by get_inds_with_intscs,
+// don't depend on the machine, so can be used to catch perf regressions
+struct Stats
+{
+    size_t pt_pt = 0; // narrow-phase calls for every pair of shape kinds
+    size_t pt_ls = 0;
+    size_t pt_tr = 0;
+    size_t ls_ls = 0;
+    size_t ls_tr = 0;
+    size_t tr_tr = 0;
+    size_t intscs = 0; // pairs found intersecting
+    size_t pruned = 0; // pairs skipped before the narrow phase by engine-specific rules
+    size_t midphase = 0; // narrow-phase calls rejected by the midphase (see midphase_rejects)
+
+    size_t narrow_calls() const {return pt_pt + pt_ls + pt_tr + ls_ls + ls_tr + tr_tr;};
+
+    Stats &operator+=(const Stats &rhs);
+};
+
+// midphase, run by every engine before the exact test of a triangle and a line segment or
+// another triangle: true if the triangle is separated from the bounding box of the other shape.
+// Pairs with disjoint bounding boxes are left to the exact test, which rejects them at once.
+bool midphase_rejects(const Geom::Triangle3D &tr, const Geom::LineSeg3D &ls);
+bool midphase_rejects(const Geom::Triangle3D &a, const Geom::Triangle3D &b);
+
+// with components every intersecting pair found is united there (by the indices of the shapes)
 std::set<index_t> get_inds_with_intscs(ListPoint3D &points, 
                                           ListLineSeg3D &linesegs, 
-                                          ListTriangle3D &triangles);
+                                          ListTriangle3D &triangles,
+                                          Stats *stats = nullptr,
+                                          UnionFind *components = nullptr);
+
+// shape of any kind, alternatives are in the order of ShapeKind
+using Shape = std::variant<Geom::Point3D, Geom::LineSeg3D, Geom::Triangle3D>;
+
+Geom::BoundingBox bound_box(const Shape &shape);
+
+// all shapes in one contiguous array with their indices and bounding boxes alongside, so that
+// pairs of any kinds are scheduled uniformly; std::visit over two shapes picks the pair test
+// from a table built at compile time, with every combination of kinds inlined. The arrays may be
+// views of a mapped scene file.
+struct ShapeArray
+{
+    Storage<index_t> inds;
+    Storage<Shape> shapes;
+    Storage<Geom::BoundingBox> boxes;
+
+    size_t size() const {return shapes.size();};
+};
+
+ShapeArray make_shape_array(const ListPoint3D &points, const ListLineSeg3D &linesegs,
+                            const ListTriangle3D &triangles);
+// of the shapes with the given indices, in this order
+ShapeArray make_shape_array(std::vector<index_t> &&inds, std::vector<Shape> &&shapes);
+
+// narrow-phase test of two shapes of any kinds, counted in stats
+bool intersects(const Shape &a, const Shape &b, Stats &stats);
+
+// brute force over the array, indices are those of arr.inds
+std::set<index_t> get_inds_with_intscs(const ShapeArray &arr, Stats *stats = nullptr,
+                                       UnionFind *components = nullptr);
+
+enum class Engine
+{
+    BruteForce, // all pairs of shapes
+    Tiled,      // all pairs too, by blocks of boxes sized for the L1 cache, in parallel
+    LBVH,       // linear bounding volume hierarchy, built and queried in parallel
+    LBVH18,     // the same over 18-DOPs: tighter volumes, fewer candidate pairs
+    BVH8,       // the LBVH collapsed into 8-wide nodes, queried by packets of shapes
+    Auto,       // picked for the scene by choose_engine
+};
+
+// the shapes are put into one array, which every engine indexes into
+std::set<index_t> get_inds_with_intscs(ListPoint3D &points, ListLineSeg3D &linesegs,
+                                       ListTriangle3D &triangles, Engine engine, Stats *stats = nullptr,
+                                       UnionFind *components = nullptr);
+std::set<index_t> get_inds_with_intscs(const ShapeArray &arr, Engine engine, Stats *stats = nullptr,
+                                       UnionFind *components = nullptr);
+
+// all shapes of a scene (or of a part of it)
+struct Shapes
+{
+    ListPoint3D points;
+    ListLineSeg3D linesegs;
+    ListTriangle3D triangles;
+};
+
+// engine for the scene: brute force for a handful of shapes, tiled for small scenes and for scenes
+// where most boxes intersect (a hierarchy can't prune anything there), BVH8 otherwise. The share of
+// intersecting boxes is estimated on a sample of shapes taken evenly from the array, so it accounts
+// for the extent of the scene and the distribution of the shape sizes at once.
+Engine choose_engine(const ShapeArray &arr);
+// for the pairs of shapes from different sets
+Engine choose_engine(const ShapeArray &a, const ShapeArray &b);
+
+// tests only pairs of shapes from different sets: indices of the shapes of 'a' which intersect
+// some shape of 'b' are added to inds_a, and vice versa
+void get_inds_with_cross_intscs(const Shapes &a, const Shapes &b, std::set<index_t> &inds_a,
+                                std::set<index_t> &inds_b, Stats *stats = nullptr,
+                                UnionFind *components = nullptr);
+
+void get_inds_with_cross_intscs(const ShapeArray &a, const ShapeArray &b, std::set<index_t> &inds_a,
+                                std::set<index_t> &inds_b, Stats *stats = nullptr,
+                                UnionFind *components = nullptr);
+
+// one array per set, which every engine indexes into
+void get_inds_with_cross_intscs(const Shapes &a, const Shapes &b, std::set<index_t> &inds_a,
+                                std::set<index_t> &inds_b, Engine engine, Stats *stats = nullptr,
+                                UnionFind *components = nullptr);
+void get_inds_with_cross_intscs(const ShapeArray &a, const ShapeArray &b, std::set<index_t> &inds_a,
+                                std::set<index_t> &inds_b, Engine engine, Stats *stats = nullptr,
+                                UnionFind *components = nullptr);
 };
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <set>
+#include <cstdint>
+#include <stdexcept>
+
+#include "driver.hpp"
+
+namespace Driver
+{
+
+// Exact mode for inputs with bounded coordinates: every coordinate is rounded to a grid of the
+// scene, x = origin + q * step with |q| <= MAX_COORD, and shapes are classified and tested on the
+// integer coordinates with orientation predicates in 64/128-bit integer arithmetic. No epsilon is
+// involved, so the result depends only on the grid and is the same on every machine. Coordinates
+// which are multiples of the step (e.g. of the resolution of a CAD model) are kept exactly.
+namespace Exact
+{
+
+const int64_t MAX_COORD = int64_t{1} << 30;
+
+class WrongGrid : public std::runtime_error
+{
+public:
+    WrongGrid(const std::string &err_msg) : std::runtime_error(err_msg) {}
+};
+
+struct Params
+{
+    double step = 0; // of the grid; 0 picks the finest power of two which fits the scene
+};
+
+struct Grid
+{
+    double step = 1;
+    int64_t origin[3] = {0, 0, 0}; // in steps, the center of the scene rounded to the grid
+};
+
+// inp is the input in the format of get_input; throws WrongGrid if the scene doesn't fit the step
+Grid choose_grid(const std::vector<double> &inp, const Params &params = {});
+
+using IPoint = std::array<int32_t, 3>;
+
+// shape on the grid: a point is v[0], a line segment is v[0]-v[1]
+struct IShape
+{
+    ShapeKind kind;
+    IPoint v[3];
+};
+
+// rounds the 9 coordinates of a shape to the grid and classifies it exactly: a point if all
+// the vertices coincide, a line segment (between the farthest two) if they are collinear
+IShape quantize(const double *coords, const Grid &grid);
+
+// exact test of two shapes, counted in stats like the narrow phase of the engines
+bool intersects(const IShape &a, const IShape &b, Stats &stats);
+
+// the broad phase is an LBVH over the boxes of the shapes on the grid, which are exact too
+std::set<index_t> get_inds_with_intscs(const std::vector<double> &inp, const Params &params = {},
+                                       Stats *stats = nullptr, UnionFind *components = nullptr);
+
+} // namespace Exact
+
+} // namespace Driver
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+#include "driver.hpp"
+
+namespace Driver
+{
+
+// Batch API for embedding: shapes are read straight from a caller-owned flat buffer, only
+// their bounding boxes are stored; Geom objects are built on the fly for the narrow phase of
+// candidate pairs found with an LBVH. Results are written into caller-provided buffers.
+namespace Flat
+{
+
+// shape i is given by 9 coordinates (x, y, z of three points) starting at data[i * stride]
+template <typename T>
+struct ShapeBuffer
+{
+    const T *data = nullptr;
+    size_t count = 0;
+    size_t stride = 9; // in elements of T, at least 9
+};
+
+class WrongBuffer : public std::runtime_error
+{
+public:
+    WrongBuffer(const std::string &err_msg) : std::runtime_error("Wrong shape buffer: " + err_msg) {}
+};
+
+// indices of the shapes intersecting some other one in increasing order: the first
+// min(total, capacity) of them are written to 'out', the total number is returned
+template <typename T>
+size_t get_inds_with_intscs(const ShapeBuffer<T> &shapes, index_t *out, size_t capacity,
+                            Stats *stats = nullptr);
+
+// pairs (i, j) with i < j of intersecting shapes in lexicographic order: pair k goes to
+// out[2k], out[2k + 1]; capacity is in pairs, the total number of pairs is returned
+template <typename T>
+size_t get_pairs_with_intscs(const ShapeBuffer<T> &shapes, index_t *out, size_t capacity,
+                             Stats *stats = nullptr);
+
+} // namespace Flat
+
+} // namespace Driver
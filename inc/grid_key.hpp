@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include "triangles.hpp"
+
+namespace Driver
+{
+
+// Keys of values equal within DBL_PRECISION, for hash maps of shapes and planes: a value is
+// snapped to the grid of DBL_PRECISION steps and the grid values are hashed as they are.
+
+// the value in DBL_PRECISION units, rounded and kept as a double; + 0.0 turns -0.0 into 0.0, both
+// must hash the same. Above ~1.8e298 it overflows to infinity, such values are not on the grid
+inline double grid_round(double x)
+{
+    return std::round(x / Geom::DBL_PRECISION) + 0.0;
+}
+
+// adds a grid value to the hash: FNV-1a over 64-bit words, with the high bits folded down
+inline uint64_t grid_hash(uint64_t hash, double value)
+{
+    uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    hash = (hash ^ bits) * 0x100000001b3ull;
+    return hash ^ (hash >> 29);
+}
+
+} // namespace Driver
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include "driver.hpp"
+#include "parallel.hpp"
+#include "storage.hpp"
+
+namespace Driver
+{
+
+// Linear bounding volume hierarchy (Karras, Maximizing Parallelism in the Construction of
+// BVHs, Octrees, and k-d Trees, 2012). Leaves are sorted by the Morton code of the box centers
+// with a parallel radix sort, every internal node is emitted independently, and node boxes
+// are computed bottom-up, all in parallel. Volume is the type of the node and leaf "boxes":
+// Geom::BoundingBox or a tighter Geom::KDop.
+template <typename Volume>
+class BasicLBVH final
+{
+public:
+    using node_t = uint32_t;
+    static const node_t LEAF_FLAG = 1u << 31; // child is a leaf with index (child & ~LEAF_FLAG)
+    // of the internal nodes, bounds the stacks of the traversals: the number of bits of the
+    // Morton code plus bits of the index
+    static const size_t MAX_DEPTH = 128;
+
+    struct Node
+    {
+        Volume box{Geom::Point3D{0, 0, 0}};
+        node_t left = 0, right = 0;
+        uint32_t last_leaf = 0; // leaves of the subtree are a contiguous range ending with this one
+    };
+private:
+    Storage<Node> nodes_;                      // internal nodes, root is nodes_[0]
+    Storage<Volume> leaf_boxes_;               // in the sorted order
+    Storage<uint32_t> leaf_items_;             // index of the box passed to ctor for every leaf
+
+    void emit_hierarchy(const std::vector<uint64_t> &codes, std::vector<node_t> &parents, std::vector<Node> &nodes);
+    void compute_boxes(const std::vector<node_t> &parents, std::vector<Node> &nodes);
+public:
+    // both builds throw std::runtime_error if there are LEAF_FLAG boxes or more
+    explicit BasicLBVH(const std::vector<Volume> &boxes);
+    // with the bounds of the box centers known, e.g. gathered while the boxes were made
+    BasicLBVH(const std::vector<Volume> &boxes, const std::array<double, 6> &center_bounds);
+    // the tree built before, e.g. views of the arrays of a mapped scene file
+    BasicLBVH(Storage<Node> nodes, Storage<Volume> leaf_boxes, Storage<uint32_t> leaf_items)
+        : nodes_(std::move(nodes)), leaf_boxes_(std::move(leaf_boxes)), leaf_items_(std::move(leaf_items)) {}
+
+    const Storage<Node> &nodes() const {return nodes_;};
+    const Storage<Volume> &leaf_boxes() const {return leaf_boxes_;};
+    const Storage<uint32_t> &leaf_items() const {return leaf_items_;};
+
+    size_t size() const {return leaf_boxes_.size();};
+    uint32_t leaf_item(size_t leaf) const {return leaf_items_[leaf];};
+    const Volume &leaf_box(size_t leaf) const {return leaf_boxes_[leaf];};
+
+    node_t root() const {return (leaf_boxes_.size() == 1) ? LEAF_FLAG : 0;};
+    const Volume &node_box(node_t node) const
+    {
+        return (node & LEAF_FLAG) ? leaf_boxes_[node & ~LEAF_FLAG] : nodes_[node].box;
+    };
+    // node must be internal
+    std::pair<node_t, node_t> children(node_t node) const {return {nodes_[node].left, nodes_[node].right};};
+    uint32_t last_leaf(node_t node) const
+    {
+        return (node & LEAF_FLAG) ? node & ~LEAF_FLAG : nodes_[node].last_leaf;
+    };
+
+    // calls on_leaf(leaf) for every leaf with index >= min_leaf whose box intersects the given one
+    template <typename F>
+    void query(const Volume &box, F &&on_leaf, size_t min_leaf = 0) const;
+
+    // calls on_leaf(query, leaf) for every leaf whose box intersects query_box(query), for all the
+    // queries in [0, n_queries). INTERLEAVE traversals are in flight at once: a step of one
+    // prefetches the children of its next node and passes on to the next traversal, so the node
+    // loads of one overlap with the work of the others. Pays off for queries in no spatial order
+    // on a tree which doesn't fit the cache (small trees are queried one by one); queries along
+    // the leaf order share their paths and are faster one by one with query().
+    template <typename Q, typename F>
+    void query_interleaved(size_t n_queries, Q &&query_box, F &&on_leaf) const;
+
+    // calls on_pair(thread_id, leaf, other_leaf) for every pair of leaves with intersecting boxes,
+    // leaf < other_leaf; every leaf is queried against the leaves after it, in parallel
+    template <typename F>
+    void query_self_pairs(F &&on_pair) const;
+
+    // dual-tree traversal in parallel: calls on_pair(thread_id, leaf, other_leaf) for every pair of
+    // a leaf of this tree and a leaf of the other one with intersecting boxes
+    template <typename F>
+    void query_pairs(const BasicLBVH &other, F &&on_pair) const;
+};
+
+using LBVH   = BasicLBVH<Geom::BoundingBox>;
+using LBVH18 = BasicLBVH<Geom::DOP18>;
+
+template <typename Volume>
+template <typename F>
+void BasicLBVH<Volume>::query(const Volume &box, F &&on_leaf, size_t min_leaf) const
+{
+    if (leaf_boxes_.size() == 1)
+    {
+        if (min_leaf == 0 && leaf_boxes_[0].intersects(box))
+            on_leaf(0);
+        return;
+    }
+
+    node_t stack[MAX_DEPTH];
+    size_t top = 0;
+    stack[top++] = 0;
+
+    while (top)
+    {
+        const Node &node = nodes_[stack[--top]];
+        for (node_t child : {node.left, node.right})
+        {
+            if (child & LEAF_FLAG)
+            {
+                node_t leaf = child & ~LEAF_FLAG;
+                if (leaf >= min_leaf && leaf_boxes_[leaf].intersects(box))
+                    on_leaf(leaf);
+            }
+            else if (nodes_[child].last_leaf >= min_leaf && nodes_[child].box.intersects(box))
+                stack[top++] = child;
+        }
+    }
+}
+
+template <typename Volume>
+template <typename Q, typename F>
+void BasicLBVH<Volume>::query_interleaved(size_t n_queries, Q &&query_box, F &&on_leaf) const
+{
+    // smaller trees stay in L2, where switching only costs (BM_traversal in src/benchmark.cpp)
+    const size_t MIN_LEAVES = 1 << 16;
+    if (leaf_boxes_.size() < MIN_LEAVES)
+    {
+        for (size_t query = 0; query < n_queries; query++)
+            this->query(query_box(query), [&](size_t leaf) {on_leaf(query, leaf);});
+        return;
+    }
+
+    const size_t INTERLEAVE = 8;
+    struct Traversal
+    {
+        Volume box{Geom::Point3D{0, 0, 0}};
+        size_t query;
+        node_t pending;       // internal node whose children are prefetched
+        size_t top;
+        node_t stack[MAX_DEPTH];
+    };
+
+    auto visit = [this](Traversal &t, node_t node)
+    {
+        t.pending = node;
+        for (node_t child : {nodes_[node].left, nodes_[node].right})
+        {
+            if (child & LEAF_FLAG)
+                __builtin_prefetch(&leaf_boxes_[child & ~LEAF_FLAG]);
+            else
+                __builtin_prefetch(&nodes_[child]);
+        }
+    };
+
+    size_t next = 0;
+    auto start = [&](Traversal &t)
+    {
+        if (next == n_queries)
+            return false;
+        t.query = next++;
+        t.box = query_box(t.query);
+        t.top = 0;
+        visit(t, 0);
+        return true;
+    };
+
+    // tests the prefetched children of the pending node, false when the traversal is over
+    auto step = [&](Traversal &t)
+    {
+        const Node &node = nodes_[t.pending];
+        for (node_t child : {node.left, node.right})
+        {
+            if (child & LEAF_FLAG)
+            {
+                if (leaf_boxes_[child & ~LEAF_FLAG].intersects(t.box))
+                    on_leaf(t.query, child & ~LEAF_FLAG);
+            }
+            else if (nodes_[child].box.intersects(t.box))
+                t.stack[t.top++] = child;
+        }
+        if (t.top == 0)
+            return false;
+        visit(t, t.stack[--t.top]);
+        return true;
+    };
+
+    Traversal ts[INTERLEAVE];
+    size_t n_active = 0;
+    while (n_active < INTERLEAVE && start(ts[n_active]))
+        n_active++;
+
+    while (n_active)
+        for (size_t i = 0; i < n_active;)
+        {
+            if (step(ts[i]) || start(ts[i]))
+                i++;
+            else
+                ts[i] = ts[--n_active];
+        }
+}
+
+template <typename Volume>
+template <typename F>
+void BasicLBVH<Volume>::query_self_pairs(F &&on_pair) const
+{
+    const size_t GRAIN = 64;
+    Parallel::for_each(size(), GRAIN, [&](size_t thr, size_t leaf)
+    {
+        query(leaf_box(leaf), [&](size_t other_leaf)
+        {
+            if (other_leaf != leaf)
+                on_pair(thr, leaf, other_leaf);
+        }, leaf);
+    });
+}
+
+template <typename Volume>
+template <typename F>
+void BasicLBVH<Volume>::query_pairs(const BasicLBVH &other, F &&on_pair) const
+{
+    if (size() == 0 || other.size() == 0)
+        return;
+
+    using NodePair = std::pair<node_t, node_t>;
+    auto is_leaf_pair = [](NodePair pair) {return (pair.first & LEAF_FLAG) && (pair.second & LEAF_FLAG);};
+    auto extent = [](const Volume &box)
+    {
+        Geom::Vector3D diag = box.max() - box.min();
+        return diag.x() + diag.y() + diag.z();
+    };
+
+    // pushes the pairs of children with intersecting boxes, the bigger of two nodes is split
+    auto split = [&](NodePair pair, std::vector<NodePair> &out)
+    {
+        auto [a, b] = pair;
+        bool split_a = !(a & LEAF_FLAG)
+                       && ((b & LEAF_FLAG) || extent(nodes_[a].box) >= extent(other.nodes_[b].box));
+        NodePair children[2];
+        if (split_a)
+        {
+            children[0] = {nodes_[a].left, b};
+            children[1] = {nodes_[a].right, b};
+        }
+        else
+        {
+            children[0] = {a, other.nodes_[b].left};
+            children[1] = {a, other.nodes_[b].right};
+        }
+        for (auto &child : children)
+            if (node_box(child.first).intersects(other.node_box(child.second)))
+                out.push_back(child);
+    };
+
+    // the top of the traversal is expanded serially until there are enough independent subtasks
+    std::vector<NodePair> tasks, next;
+    if (node_box(root()).intersects(other.node_box(other.root())))
+        tasks.push_back({root(), other.root()});
+
+    const size_t TASKS_PER_THREAD = 16;
+    bool expanded = true;
+    while (expanded && tasks.size() < TASKS_PER_THREAD * Parallel::n_threads())
+    {
+        expanded = false;
+        next.clear();
+        for (auto pair : tasks)
+        {
+            if (is_leaf_pair(pair))
+                next.push_back(pair);
+            else
+            {
+                split(pair, next);
+                expanded = true;
+            }
+        }
+        tasks.swap(next);
+    }
+
+    Parallel::for_each(tasks.size(), 1, [&](size_t thr, size_t task)
+    {
+        std::vector<NodePair> stack{tasks[task]};
+        while (!stack.empty())
+        {
+            NodePair pair = stack.back();
+            stack.pop_back();
+            if (is_leaf_pair(pair))
+                on_pair(thr, pair.first & ~LEAF_FLAG, pair.second & ~LEAF_FLAG);
+            else
+                split(pair, stack);
+        }
+    });
+}
+
+// parallel LSD radix sort of the keys, values are permuted along with them
+void parallel_radix_sort(std::vector<uint64_t> &keys, std::vector<uint32_t> &values);
+
+// instantiated for Geom::BoundingBox and Geom::DOP18
+template <typename Volume = Geom::BoundingBox>
+std::set<index_t> get_inds_with_intscs_lbvh(const ShapeArray &arr, Stats *stats = nullptr,
+                                            UnionFind *components = nullptr);
+
+// pairs of shapes (positions in the array) which are not tested, counted in Stats::pruned
+using PairFilter = std::function<bool(size_t item, size_t other)>;
+
+// the same with a tree built before over the boxes of the shapes, e.g. taken from a scene file,
+// and the pairs skip() filters out left untested; instantiated for LBVH
+template <typename Volume>
+std::set<index_t> get_inds_with_intscs_lbvh(const ShapeArray &arr, const BasicLBVH<Volume> &bvh,
+                                            Stats *stats = nullptr, UnionFind *components = nullptr,
+                                            const PairFilter &skip = nullptr);
+
+// only pairs of shapes from different sets are tested, with one LBVH per set
+template <typename Volume = Geom::BoundingBox>
+void get_inds_with_cross_intscs_lbvh(const ShapeArray &a, const ShapeArray &b, std::set<index_t> &inds_a,
+                                     std::set<index_t> &inds_b, Stats *stats = nullptr,
+                                     UnionFind *components = nullptr);
+
+} // namespace Driver
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <string>
+#include <iostream>
+
+#include "driver.hpp"
+
+namespace Driver
+{
+
+// indexed mesh: faces reference shared vertices instead of storing copies of them;
+// polygons are triangulated as fans, so face indices are indices of the triangles
+struct Mesh
+{
+    std::vector<Geom::Point3D> vertices;
+    std::vector<std::array<uint32_t, 3>> faces;
+};
+
+class WrongMeshInput : public std::runtime_error
+{
+public:
+    WrongMeshInput(const std::string &err_msg) : std::runtime_error("Wrong mesh input: " + err_msg) {}
+};
+
+// Wavefront OBJ: only 'v' and 'f' lines are used ('f' indices may be negative and have /vt/vn parts)
+Mesh read_obj(std::istream &stream);
+
+// PLY: ascii, binary_little_endian or binary_big_endian; 'vertex' element with x, y, z
+// and 'face' element with a vertex_indices (or vertex_index) list
+Mesh read_ply(std::istream &stream);
+
+// indices of the faces intersecting some other face; with ignore_adjacent pairs of faces sharing
+// a vertex are not intersections (usual meaning of mesh self-intersection) and are pruned
+// before the narrow phase. Shapes are built from the shared vertices only for the narrow phase.
+std::set<index_t> get_faces_with_intscs(const Mesh &mesh, bool ignore_adjacent, Stats *stats = nullptr);
+
+} // namespace Driver
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+namespace Driver
+{
+
+// 3D Morton (Z-order) codes of points quantized on the 2^21 x 2^21 x 2^21 grid over the given box
+class MortonGrid final
+{
+private:
+    static const uint32_t GRID_SIZE = 1u << 21;
+
+    double min_[3];
+    double scale_[3];
+
+    // spreads the lower 21 bits of v so that there are two zero bits between each of them
+    static uint64_t spread_bits(uint64_t v)
+    {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffULL;
+        v = (v | v << 16) & 0x1f0000ff0000ffULL;
+        v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+        v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+        v = (v | v << 2)  & 0x1249249249249249ULL;
+        return v;
+    }
+
+    uint32_t quantize(double x, int axis) const
+    {
+        double cell = (x - min_[axis]) * scale_[axis];
+        return static_cast<uint32_t>(std::clamp(cell, 0.0, static_cast<double>(GRID_SIZE - 1)));
+    }
+public:
+    MortonGrid(const double min[3], const double max[3])
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            double extent = max[axis] - min[axis];
+            min_[axis] = min[axis];
+            scale_[axis] = (extent > 0) ? GRID_SIZE / extent : 0;
+        }
+    }
+
+    static uint64_t interleave(uint32_t x, uint32_t y, uint32_t z)
+    {
+        return spread_bits(x) << 2 | spread_bits(y) << 1 | spread_bits(z);
+    }
+
+    uint64_t code(double x, double y, double z) const
+    {
+        return interleave(quantize(x, 0), quantize(y, 1), quantize(z, 2));
+    }
+};
+
+} // namespace Driver
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "driver.hpp"
+
+namespace Driver
+{
+
+// Pipeline for the inputs which don't fit in memory: shapes are streamed from the input
+// into an on-disk file, externally sorted by the Morton code of the centroid and split into
+// chunks; then every chunk is tested against itself and against every chunk with overlapping
+// bounds by the engine of params. The result is the same as of get_inds_with_intscs on the whole input.
+namespace OutOfCore
+{
+
+struct Params
+{
+    size_t mem_budget = 256 << 20; // bytes for the sort runs and for two loaded chunks
+    std::string tmp_dir = "/tmp";
+    Engine engine = Engine::Auto;  // for a chunk and for a pair of chunks
+};
+
+// writes indices of the shapes intersecting some other one to 'out', in increasing order
+void get_inds_with_intscs(std::istream &in, std::ostream &out, const Params &params,
+                          Stats *stats = nullptr);
+
+} // namespace OutOfCore
+
+} // namespace Driver
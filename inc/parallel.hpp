@@ -0,0 +1,113 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <mutex>
+
+namespace Driver
+{
+
+namespace Parallel
+{
+
+// 0 means std::thread::hardware_concurrency()
+inline size_t threads_setting = 0;
+
+inline size_t n_threads()
+{
+    if (threads_setting)
+        return threads_setting;
+    return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+// runs f(thread_id) on n_threads() threads, the calling thread is thread 0. An exception thrown by
+// f on any thread doesn't escape the thread: the first one is kept, every thread is joined and
+// then it is rethrown to the caller
+template <typename F>
+void run(F &&f)
+{
+    size_t n = n_threads();
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto guarded = [&](size_t id)
+    {
+        try
+        {
+            f(id);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(n - 1);
+    try
+    {
+        for (size_t id = 1; id < n; id++)
+            threads.emplace_back(guarded, id);
+    }
+    catch (...) // no more threads: the ones started are still joined
+    {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error)
+            error = std::current_exception();
+    }
+    if (!error)
+        guarded(0);
+    for (auto &thread : threads)
+        thread.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// splits [0, n) into n_threads() consecutive blocks and calls f(thread_id, begin, end) for each
+template <typename F>
+void for_blocks(size_t n, F &&f)
+{
+    size_t n_thr = n_threads();
+    size_t block = (n + n_thr - 1) / n_thr;
+    run([&](size_t id)
+    {
+        size_t begin = std::min(n, id * block), end = std::min(n, begin + block);
+        f(id, begin, end);
+    });
+}
+
+// calls f(thread_id, i) for every i in [0, n), threads take work by 'grain' items at a time;
+// after an exception in f no thread takes more work
+template <typename F>
+void for_each(size_t n, size_t grain, F &&f)
+{
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    run([&](size_t id)
+    {
+        size_t begin = 0;
+        while (!failed.load(std::memory_order_relaxed)
+               && (begin = next.fetch_add(grain, std::memory_order_relaxed)) < n)
+        {
+            size_t end = std::min(n, begin + grain);
+            try
+            {
+                for (size_t i = begin; i < end; i++)
+                    f(id, i);
+            }
+            catch (...)
+            {
+                failed.store(true, std::memory_order_relaxed);
+                throw;
+            }
+        }
+    });
+}
+
+} // namespace Parallel
+
+} // namespace Driver
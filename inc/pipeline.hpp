@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <iostream>
+
+#include "driver.hpp"
+
+namespace Driver
+{
+
+// get_input and parse_input as concurrent stages: reading of the numbers, classification of
+// the shapes and assembly of the scene run on their own threads connected by bounded lock-free
+// queues of batches, so the time of parsing a large input approaches the time of its slowest stage.
+// Result (and error messages) are the same as of get_input + parse_input: a failed stage keeps
+// draining its input, so an error of reading wins over one of a shape, as it does there.
+namespace Pipeline
+{
+
+struct Params
+{
+    size_t batch_size = 4096;   // shapes in one batch
+    size_t queue_capacity = 16; // batches in one queue
+};
+
+void parse_input(std::istream &stream, ListPoint3D &points_out, ListLineSeg3D &linesegs_out,
+                 ListTriangle3D &triangles_out, const Params &params = Params{});
+
+// the shapes in the order of the input with their boxes, for the tree engines
+struct Scene
+{
+    std::vector<index_t> inds;
+    std::vector<Shape> shapes;
+    std::vector<Geom::BoundingBox> boxes;
+    std::array<double, 6> center_bounds; // min and max of the box centers, for the Morton grid
+};
+
+// the same stages followed by the broad phase insertion: the boxes of a batch and the bounds of
+// their centers are computed on a stage of their own, so the tree build starts from them
+Scene parse_scene(std::istream &stream, const Params &params = Params{});
+
+} // namespace Pipeline
+
+} // namespace Driver
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "driver.hpp"
+#include "lbvh.hpp"
+#include "bvh8.hpp"
+
+namespace Driver
+{
+
+// Binary scene file: the shapes of the scene with their derived data and the trees built over
+// them, so that later runs mmap it and query it in place, skipping reading, parsing and building.
+// Arrays are stored as they are in memory, at offsets aligned for any of them, so the file is
+// position-independent but belongs to builds with the same layout of the shapes and the nodes.
+namespace SceneFile
+{
+
+const char MAGIC[8] = {'T', 'R', 'I', 'S', 'C', 'E', 'N', 'E'};
+const uint32_t VERSION = 2;
+const size_t ALIGNMENT = 64;
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t src_checksum; // fnv1a64 of the source text input
+    // sizes of the elements, a file of a build with another layout is rejected
+    uint64_t shape_size, lbvh_node_size, bvh8_node_size;
+    uint64_t n_points, n_linesegs, n_triangles; // shapes are stored in this order
+    uint64_t n_lbvh_nodes, n_bvh8_nodes;
+    // from the beginning of the file: ShapeArray of the scene, then LBVH and BVH8 over its boxes
+    uint64_t inds_offset, shapes_offset, boxes_offset;
+    uint64_t lbvh_nodes_offset, lbvh_leaf_boxes_offset, lbvh_leaf_items_offset;
+    uint64_t bvh8_nodes_offset, bvh8_leaf_boxes_offset, bvh8_leaf_items_offset;
+
+    uint64_t n_shapes() const {return n_points + n_linesegs + n_triangles;};
+};
+
+class WrongSceneFile : public std::runtime_error
+{
+public:
+    WrongSceneFile(const std::string &err_msg) : std::runtime_error(err_msg) {}
+};
+
+uint64_t checksum(const char *data, size_t size);
+
+void save(const std::string &filename, uint64_t src_checksum, const ListPoint3D &points,
+          const ListLineSeg3D &linesegs, const ListTriangle3D &triangles);
+
+// read-only memory mapping of a scene file, checks magic, version, layout, that every array
+// is inside the file and that the kinds and indices of the shapes and the trees are valid (the
+// coordinates and the boxes are not checked); the shapes and the trees are views of the mapping
+class Mapped final
+{
+private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+
+    template <typename T>
+    const T *array(uint64_t offset, uint64_t n) const;
+public:
+    explicit Mapped(const std::string &filename);
+    ~Mapped();
+
+    Mapped(const Mapped &) = delete;
+    Mapped &operator=(const Mapped &) = delete;
+
+    const Header &header() const {return *reinterpret_cast<const Header *>(data_);};
+
+    ShapeArray shapes() const;
+    LBVH lbvh() const;
+    BVH8 bvh8() const;
+
+    // copies the shapes to the lists, for the modes which change them or need other engines
+    void load(ListPoint3D &points_out, ListLineSeg3D &linesegs_out, ListTriangle3D &triangles_out) const;
+
+    // the engines with a tree in the file: LBVH, and BVH8 which is taken for Auto as well
+    static bool has_tree(Engine engine);
+    // queries the mapped shapes with the stored tree of the engine
+    std::set<index_t> get_inds_with_intscs(Engine engine, Stats *stats = nullptr,
+                                           UnionFind *components = nullptr) const;
+};
+
+} // namespace SceneFile
+
+} // namespace Driver
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <optional>
+#include <variant>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+
+#include "driver.hpp"
+#include "lbvh.hpp"
+
+namespace Driver
+{
+
+// Scene server: the scene is parsed once and stays resident with its LBVH, requests come over
+// a Unix domain socket, one thread per client. Protocol is line based, every request line gets
+// one response line: "OK" with the results separated by spaces, or "ERR <message>".
+//
+//   ALL                     indices of the shapes intersecting some other shape (as Driver prints)
+//   QUERY x1 y1 z1 ... z3   indices of the shapes intersecting the given one (9 coordinates)
+//   ADD x1 y1 z1 ... z3     adds the shape, responds with its index
+//   REMOVE i                removes shape i, indices of other shapes don't change
+//   SIZE                    number of shapes in the scene
+//   QUIT                    closes the connection
+//   SHUTDOWN                stops the server
+namespace Server
+{
+
+class WrongRequest : public std::runtime_error
+{
+public:
+    WrongRequest(const std::string &err_msg) : std::runtime_error(err_msg) {}
+};
+
+// Edits don't rebuild the LBVH at once: added shapes are kept aside and tested one by one,
+// removed shapes are skipped in the tree; it is rebuilt over the present shapes when the edits
+// pile up. Queries share the scene, edits lock it. The result of ALL is cached and edits update
+// it with queries of the added or removed shape and of its neighbours. ALL is computed in parallel
+// by one request at a time; an error of its narrow phase is thrown to the request and not cached.
+class Scene final
+{
+    // vertices only, the full shapes are built when they are tested
+    using StoredShape = std::variant<Geom::Point3D, Geom::CompactLineSeg3D<double>, Geom::CompactTriangle3D<double>>;
+
+    // by index, removed shapes stay in place; a deque isn't copied when a shape is added
+    std::deque<StoredShape> shapes_;
+    std::deque<Geom::BoundingBox> boxes_;
+    std::vector<bool> present_;
+    size_t n_present_ = 0;
+
+    std::vector<index_t> indexed_;         // index of the shape of every LBVH item
+    std::optional<LBVH> bvh_;
+    std::vector<index_t> added_;           // since the last rebuild
+    size_t n_removed_ = 0;                 // from the LBVH since the last rebuild
+
+    mutable std::shared_mutex mutex_;
+    mutable std::mutex cache_mutex_;       // taken after mutex_
+    mutable std::optional<std::vector<index_t>> all_;
+
+    void rebuild();
+    void rebuild_if_needed();
+
+    // calls on_shape(ind) for every present shape whose box intersects the given one
+    template <typename F>
+    void for_candidates(const Geom::BoundingBox &box, F &&on_shape) const;
+    Shape shape(index_t ind) const;
+    // present shapes intersecting the given one, not sorted
+    std::vector<index_t> intersecting(const Shape &shape) const;
+public:
+    Scene(const ListPoint3D &points, const ListLineSeg3D &linesegs, const ListTriangle3D &triangles);
+
+    std::vector<index_t> intersections() const;
+    std::vector<index_t> query(const Shape &shape) const;
+    index_t add(const Shape &shape);
+    void remove(index_t ind);
+    size_t size() const;
+};
+
+// serves the scene until SHUTDOWN; a stale socket file at the path is replaced
+void serve(Scene &scene, const std::string &socket_path);
+
+} // namespace Server
+
+} // namespace Driver
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+
+namespace Driver
+{
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// push() and pop() wait while the queue is full or empty: they spin for a while and then
+// back off to short sleeps, so a waiting stage doesn't take the core from a working one.
+// close() wakes both sides up: pop() drains the rest and then fails, push() fails at once.
+template <typename T>
+class SPSCQueue final
+{
+    static const size_t CACHE_LINE = 64;
+
+    std::vector<T> slots_;
+    alignas(CACHE_LINE) std::atomic<size_t> head_{0}; // next slot to pop, written by the consumer
+    alignas(CACHE_LINE) std::atomic<size_t> tail_{0}; // next slot to push, written by the producer
+    alignas(CACHE_LINE) std::atomic<bool> closed_{false};
+
+    static void backoff(unsigned &n_waits)
+    {
+        const unsigned SPINS = 64;
+        const unsigned MAX_SLEEP_US = 1000;
+        if (n_waits < SPINS)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(std::min(MAX_SLEEP_US, (n_waits - SPINS + 1) * 10)));
+        n_waits++;
+    }
+public:
+    explicit SPSCQueue(size_t capacity) : slots_(capacity + 1) {};
+
+    SPSCQueue(const SPSCQueue &) = delete;
+    SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+    // false if the queue was closed, the item is dropped then
+    bool push(T &&item)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) % slots_.size();
+        unsigned n_waits = 0;
+        while (next == head_.load(std::memory_order_acquire))
+        {
+            if (closed_.load(std::memory_order_acquire))
+                return false;
+            backoff(n_waits);
+        }
+        if (closed_.load(std::memory_order_acquire))
+            return false;
+
+        slots_[tail] = std::move(item);
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // false if the queue is closed and empty
+    bool pop(T &item)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        unsigned n_waits = 0;
+        while (head == tail_.load(std::memory_order_acquire))
+        {
+            if (closed_.load(std::memory_order_acquire))
+            {
+                // the producer could push right before closing
+                if (head != tail_.load(std::memory_order_acquire))
+                    break;
+                return false;
+            }
+            backoff(n_waits);
+        }
+
+        item = std::move(slots_[head]);
+        head_.store((head + 1) % slots_.size(), std::memory_order_release);
+        return true;
+    }
+
+    void close() {closed_.store(true, std::memory_order_release);};
+};
+
+} // namespace Driver
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+namespace Driver
+{
+
+// array of a tree or of the shapes: either owned in a vector, or a read-only view of elements
+// owned by someone else (a mapped scene file), so that the same code queries both. Reads go
+// through one pointer either way; a structure builds its elements in a vector and moves it in.
+template <typename T>
+class Storage final
+{
+    std::vector<T> own_;
+    const T *data_ = nullptr;
+    size_t size_ = 0;
+    bool view_ = false;
+public:
+    Storage() = default;
+    explicit Storage(std::vector<T> &&own) : own_(std::move(own)), data_(own_.data()), size_(own_.size()) {}
+    Storage(const T *data, size_t size) : data_(data), size_(size), view_(true) {}
+
+    Storage(const Storage &other) : own_(other.own_), data_(other.view_ ? other.data_ : own_.data()),
+                                    size_(other.size_), view_(other.view_) {}
+    // a moved vector keeps its elements where they are
+    Storage(Storage &&other) noexcept : own_(std::move(other.own_)), data_(other.data_), size_(other.size_),
+                                        view_(other.view_) {}
+    Storage &operator=(Storage other) noexcept
+    {
+        own_.swap(other.own_);
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(view_, other.view_);
+        return *this;
+    }
+
+    size_t size() const {return size_;};
+    bool empty() const {return size_ == 0;};
+    bool is_view() const {return view_;};
+    const T *data() const {return data_;};
+    const T *begin() const {return data_;};
+    const T *end() const {return data_ + size_;};
+    const T &operator[](size_t i) const {return data_[i];};
+};
+
+} // namespace Driver
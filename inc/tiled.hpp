@@ -0,0 +1,19 @@
+#pragma once
+
+#include "driver.hpp"
+
+namespace Driver
+{
+
+// Cache-blocked brute force: the boxes of all shapes are kept as contiguous coordinate arrays
+// and split into blocks sized for the L1 cache; every pair of blocks (a tile) is one parallel
+// task, whose branchless box loop is vectorized by the compiler. Only pairs with intersecting
+// boxes go to the narrow phase, so the counters are the same as of the LBVH engines.
+std::set<index_t> get_inds_with_intscs_tiled(const ShapeArray &arr, Stats *stats = nullptr,
+                                             UnionFind *components = nullptr);
+
+void get_inds_with_cross_intscs_tiled(const ShapeArray &a, const ShapeArray &b, std::set<index_t> &inds_a,
+                                      std::set<index_t> &inds_b, Stats *stats = nullptr,
+                                      UnionFind *components = nullptr);
+
+} // namespace Driver
@@ -5,6 +5,9 @@
 #include <stdexcept>
 #include <optional>
 #include <cassert>
+#include <array>
+#include <initializer_list>
+#include <type_traits>
 
 namespace Geom
 {
@@ -71,9 +74,50 @@ private:
 public:
     BoundingBox(std::initializer_list<Point3D> points);
 
+    Point3D min() const {return Point3D{min_x_, min_y_, min_z_};};
+    Point3D max() const {return Point3D{max_x_, max_y_, max_z_};};
+    Point3D center() const;
+
+    // makes this box the bounding box of itself and the other one
+    BoundingBox& expand(const BoundingBox& other);
+
     bool intersects(const BoundingBox& other) const;
 };
 
+// discrete oriented polytope: intersection of K/2 slabs along fixed directions, a tighter
+// bounding volume than BoundingBox for diagonal shapes. K is 6 (same as BoundingBox),
+// 14 (+ corner diagonals), 18 (+ edge diagonals) or 26 (+ both)
+template <size_t K>
+class KDop final
+{
+    static_assert(K == 6 || K == 14 || K == 18 || K == 26, "K must be 6, 14, 18 or 26");
+public:
+    static constexpr size_t N_AXES = K / 2;
+private:
+    // coordinate axes, then edge diagonals, then corner diagonals; not normalized
+    static constexpr scalar_t ALL_AXES[13][3] = {
+        {1, 0, 0}, {0, 1, 0}, {0, 0, 1},
+        {1, 1, 0}, {1, 0, 1}, {0, 1, 1}, {1, -1, 0}, {1, 0, -1}, {0, 1, -1},
+        {1, 1, 1}, {1, 1, -1}, {1, -1, 1}, {-1, 1, 1}
+    };
+    static constexpr const scalar_t *axis(size_t i) {return ALL_AXES[(K == 14 && i >= 3) ? i + 6 : i];};
+
+    std::array<scalar_t, N_AXES> min_, max_;
+public:
+    KDop(std::initializer_list<Point3D> points);
+
+    // first three slabs are the bounding box
+    Point3D min() const {return Point3D{min_[0], min_[1], min_[2]};};
+    Point3D max() const {return Point3D{max_[0], max_[1], max_[2]};};
+    Point3D center() const {return Point3D{(min_[0] + max_[0]) / 2, (min_[1] + max_[1]) / 2, (min_[2] + max_[2]) / 2};};
+
+    KDop& expand(const KDop& other);
+
+    bool intersects(const KDop& other) const;
+};
+
+using DOP18 = KDop<18>;
+
 class Vector3D final
 {
 private:
@@ -125,8 +169,8 @@ public:
     bool operator==(const Line3D &rhs) const;
     bool is_parallel_to(const Line3D &rhs) const;
 
-    Vector3D dir() const;
-    Point3D p() const;
+    const Vector3D &dir() const {return dir_;};
+    const Point3D &p() const {return p_;};
 
     bool has_point(Point3D q) const;
 };
@@ -148,10 +192,12 @@ public:
     LineSeg3D(Point3D p1, Point3D p2);
     LineSeg3D(Point3D p, Vector3D v);
 
-    Point3D p1() const;
-    Point3D p2() const;
-    Vector3D vec() const;
-    BoundingBox bound_box() const;
+    const Point3D &p1() const {return p1_;};
+    const Point3D &p2() const {return p2_;};
+    const Vector3D &vec() const {return vec_;};
+    const BoundingBox &bound_box() const {return bound_box_;};
+    // computed on request, shapes store only the bounding box
+    template <size_t K> KDop<K> kdop() const {return KDop<K>{p1_, p2_};};
 
     bool has_point(Point3D q) const;
     bool intersects_LineSeg3D(const LineSeg3D &ls) const;
@@ -175,8 +221,8 @@ public:
     bool operator==(const Plane &rhs) const;
     bool is_parallel_to(const Plane &rhs) const;
 
-    Vector3D n_vec() const;
-    Point3D p() const;
+    const Vector3D &n_vec() const {return n_vec_;};
+    const Point3D &p() const {return p_;};
 
     bool has_point(Point3D q) const;
 
@@ -203,16 +249,114 @@ public:
 
     Triangle3D(Point3D p1, Point3D p2, Point3D p3);
 
-    Point3D p1() const;
-    Point3D p2() const;
-    Point3D p3() const;
-    Plane plane() const;
-    BoundingBox bound_box() const;
+    const Point3D &p1() const {return p1_;};
+    const Point3D &p2() const {return p2_;};
+    const Point3D &p3() const {return p3_;};
+    const Plane &plane() const {return plane_;};
+    const BoundingBox &bound_box() const {return bound_box_;};
+    template <size_t K> KDop<K> kdop() const {return KDop<K>{p1_, p2_, p3_};};
 
     bool has_point(const Point3D& p) const;
 
     bool intersects_LineSeg3D(const LineSeg3D& lineseg) const;
     bool intersects_Triangle3D(const Triangle3D& triangle) const;
+
+    // separating axis test (Akenine-Moller, Fast 3D Triangle-Box Overlap Testing, 2001) of the
+    // triangle and the box expanded by margin on every side; cheaper than the exact tests,
+    // so it is used to reject pairs of shapes whose boxes overlap but which can't touch
+    bool intersects_BoundingBox(const BoundingBox& box, scalar_t margin = 0) const;
 };
 
+// Compact variants for keeping many shapes resident: only the vertices, in double or in float
+// (the vertices are rounded then). Derived data is computed on demand: the box by bound_box(),
+// the full shape with its plane and box for the exact tests by full(). Constructors throw like
+// the ones of the full shapes if the rounded vertices are degenerate.
+template <typename T>
+class CompactLineSeg3D final
+{
+    std::array<T, 6> coords_;
+public:
+    explicit CompactLineSeg3D(const LineSeg3D &ls);
+
+    Point3D p1() const {return Point3D{coords_[0], coords_[1], coords_[2]};};
+    Point3D p2() const {return Point3D{coords_[3], coords_[4], coords_[5]};};
+    BoundingBox bound_box() const {return BoundingBox{p1(), p2()};};
+    LineSeg3D full() const {return LineSeg3D{p1(), p2()};};
+};
+
+template <typename T>
+class CompactTriangle3D final
+{
+    std::array<T, 9> coords_;
+public:
+    explicit CompactTriangle3D(const Triangle3D &tr);
+
+    Point3D p1() const {return Point3D{coords_[0], coords_[1], coords_[2]};};
+    Point3D p2() const {return Point3D{coords_[3], coords_[4], coords_[5]};};
+    Point3D p3() const {return Point3D{coords_[6], coords_[7], coords_[8]};};
+    BoundingBox bound_box() const {return BoundingBox{p1(), p2(), p3()};};
+    Triangle3D full() const {return Triangle3D{p1(), p2(), p3()};};
+};
+
+namespace IntsctTrig3DHelpers
+{
+
+// exact test of two triangles on one plane (t0.plane() == t1.plane()), separating axes are the
+// edge normals within the plane; used directly by the engines that group coplanar triangles
+bool intersects_Triangle2D(const Triangle3D &t0, const Triangle3D &t1);
+
+} // namespace IntsctTrig3DHelpers
+
+template <size_t K>
+KDop<K>::KDop(std::initializer_list<Point3D> points)
+{
+    min_.fill(INFINITY);
+    max_.fill(-INFINITY);
+    for (auto &p : points)
+        for (size_t i = 0; i < N_AXES; i++)
+        {
+            const scalar_t *a = axis(i);
+            scalar_t proj = a[0] * p.x() + a[1] * p.y() + a[2] * p.z();
+            if (proj < min_[i]) min_[i] = proj;
+            if (proj > max_[i]) max_[i] = proj;
+        }
+}
+
+template <size_t K>
+KDop<K>& KDop<K>::expand(const KDop &other)
+{
+    for (size_t i = 0; i < N_AXES; i++)
+    {
+        if (other.min_[i] < min_[i]) min_[i] = other.min_[i];
+        if (other.max_[i] > max_[i]) max_[i] = other.max_[i];
+    }
+    return *this;
+}
+
+template <size_t K>
+bool KDop<K>::intersects(const KDop &other) const
+{
+    for (size_t i = 0; i < N_AXES; i++)
+        if (!leq(min_[i], other.max_[i]) || !leq(other.min_[i], max_[i]))
+            return false;
+    return true;
+}
+
+template <typename T>
+CompactLineSeg3D<T>::CompactLineSeg3D(const LineSeg3D &ls)
+    : coords_{T(ls.p1().x()), T(ls.p1().y()), T(ls.p1().z()), T(ls.p2().x()), T(ls.p2().y()), T(ls.p2().z())}
+{
+    if constexpr (!std::is_same_v<T, scalar_t>)
+        full();
+}
+
+template <typename T>
+CompactTriangle3D<T>::CompactTriangle3D(const Triangle3D &tr)
+    : coords_{T(tr.p1().x()), T(tr.p1().y()), T(tr.p1().z()), T(tr.p2().x()), T(tr.p2().y()), T(tr.p2().z()),
+              T(tr.p3().x()), T(tr.p3().y()), T(tr.p3().z())}
+{
+    if constexpr (!std::is_same_v<T, scalar_t>)
+        full();
+}
+
 } // namespace Geom
\ No newline at end of file
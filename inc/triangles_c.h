@@ -0,0 +1,46 @@
+#ifndef TRIANGLES_C_H
+#define TRIANGLES_C_H
+
+/* C ABI of the batch API (see flat_api.hpp), no C++ exceptions cross it */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    TRI_OK          = 0,
+    TRI_WRONG_ARGS  = 1, /* NULL pointers, stride less than 9 */
+    TRI_WRONG_INPUT = 2, /* NaN coordinates and other invalid shapes */
+    TRI_ERROR       = 3  /* out of memory and other failures */
+} tri_status_t;
+
+/*
+ * Shape i is given by 9 coordinates (x, y, z of three points) starting at coords[i * stride];
+ * 'count' shapes, stride is in elements.
+ *
+ * tri_intersecting_indices_*: indices of the shapes intersecting some other one in increasing
+ * order, the first min(*n_out, capacity) of them are written to 'out', *n_out is the total number.
+ *
+ * tri_intersecting_pairs_*: pairs (i, j) with i < j of intersecting shapes in lexicographic order,
+ * pair k goes to out[2k], out[2k + 1]; capacity and *n_out are in pairs.
+ */
+tri_status_t tri_intersecting_indices_d(const double *coords, size_t count, size_t stride,
+                                        size_t *out, size_t capacity, size_t *n_out);
+tri_status_t tri_intersecting_indices_f(const float *coords, size_t count, size_t stride,
+                                        size_t *out, size_t capacity, size_t *n_out);
+tri_status_t tri_intersecting_pairs_d(const double *coords, size_t count, size_t stride,
+                                      size_t *out, size_t capacity, size_t *n_out);
+tri_status_t tri_intersecting_pairs_f(const float *coords, size_t count, size_t stride,
+                                      size_t *out, size_t capacity, size_t *n_out);
+
+/* message of the last error of the calling thread, "" if there was none */
+const char *tri_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRIANGLES_C_H */
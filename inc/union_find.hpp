@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <utility>
+
+namespace Driver
+{
+
+// Lock-free disjoint set union of the shapes by their indices (Anderson, Woll, Wait-free
+// Parallel Algorithms for the Union-Find Problem, 1991): unite() may be called from several
+// threads at once. The bigger root is always linked to the smaller one, so the root of
+// a component is its smallest index; find() halves the path.
+class UnionFind final
+{
+    std::vector<std::atomic<size_t>> parent_;
+public:
+    explicit UnionFind(size_t size) : parent_(size)
+    {
+        for (size_t i = 0; i < size; i++)
+            parent_[i].store(i, std::memory_order_relaxed);
+    };
+
+    size_t size() const {return parent_.size();};
+
+    size_t find(size_t x)
+    {
+        while (true)
+        {
+            size_t parent = parent_[x].load(std::memory_order_acquire);
+            if (parent == x)
+                return x;
+            size_t grand = parent_[parent].load(std::memory_order_acquire);
+            if (grand != parent)
+                parent_[x].compare_exchange_weak(parent, grand, std::memory_order_acq_rel);
+            x = grand;
+        }
+    };
+
+    void unite(size_t a, size_t b)
+    {
+        while (true)
+        {
+            a = find(a);
+            b = find(b);
+            if (a == b)
+                return;
+            if (a < b)
+                std::swap(a, b);
+            // fails if a stopped being a root meanwhile, then both roots are found again
+            size_t expected = a;
+            if (parent_[a].compare_exchange_strong(expected, b, std::memory_order_acq_rel))
+                return;
+        }
+    };
+};
+
+} // namespace Driver
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <optional>
+#include <utility>
+#include <string>
+#include <functional>
+
+#include "driver.hpp"
+
+namespace Driver
+{
+
+// Differential verification of an accelerated engine against the brute force on the same
+// shapes (a random sample of them for huge inputs). For an index the two disagree on
+// the shapes are searched for a pair which reproduces the disagreement on its own.
+namespace Verify
+{
+
+struct Params
+{
+    size_t sample = 20000;  // inputs with more shapes are verified on a random sample of this size
+    uint64_t seed = 1;      // of the sample
+    size_t max_repros = 3;  // mismatches to search a reproducing pair for
+};
+
+struct Mismatch
+{
+    index_t ind;
+    bool by_engine; // ind is reported by the engine (and not by the brute force) or vice versa
+    std::optional<std::pair<index_t, index_t>> repro; // pair of shapes reproducing the mismatch
+};
+
+struct Report
+{
+    size_t n_shapes = 0;   // in the input
+    size_t n_checked = 0;  // in the sample
+    std::vector<Mismatch> mismatches;
+    std::optional<std::string> engine_error; // what the engine threw on the sample, nothing is compared then
+};
+
+// the engine under test: indices of the intersecting shapes of the array
+using Finder = std::function<std::set<index_t>(const ShapeArray &arr)>;
+
+// inp is the input in the format of get_input; errors of the brute force (of the input) are thrown
+Report verify(const std::vector<double> &inp, const Finder &engine, const Params &params = Params{});
+Report verify(const std::vector<double> &inp, Engine engine, const Params &params = Params{});
+
+// writes the scene of two shapes of the input in the E2E_tests/*.in format
+void write_pair_input(std::ostream &out, const std::vector<double> &inp, std::pair<index_t, index_t> pair);
+
+} // namespace Verify
+
+} // namespace Driver
@@ -0,0 +1,12 @@
+#!/bin/bash
+
+# Merges outputs of 'Driver --shard ID/COUNT' runs into the global result.
+# Each shard output is a sorted set of global indices, and every intersecting pair
+# is found by at least one shard, so the result is their sorted union.
+
+if [ $# -lt 1 ]; then
+    printf "Usage: %s <shard output>...\n" "$0" >&2
+    exit 1
+fi
+
+sort -m -n -u "$@"
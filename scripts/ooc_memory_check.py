@@ -0,0 +1,61 @@
+import sys
+import random
+import argparse
+import subprocess
+
+# Checks that Driver --out-of-core keeps within its memory budget: the peak RSS of a run on a
+# scene of many chunks must not exceed the peak RSS of a run on a one-shape scene (the binary,
+# the libraries and the thread stacks) by more than the budget. The peak RSS is the one Driver
+# reports with --alloc-stats: that of the rusage of a child includes the memory of the parent
+# it was forked from. The indices must be the same as of the in-memory run.
+
+def gen_scene(n, seed):
+    rnd = random.Random(seed)
+    lines = [str(n)]
+    for _ in range(n):
+        base = [rnd.uniform(0, 100) for _ in range(3)]
+        coords = [base[k % 3] + rnd.uniform(0, 1) for k in range(9)]
+        lines.append(' '.join(f"{c:.6f}" for c in coords))
+    return '\n'.join(lines) + '\n'
+
+def run(args, inp):
+    result = subprocess.run(args, input=inp, capture_output=True, text=True)
+    if result.returncode != 0:
+        print(f"Error: {' '.join(args)} failed: {result.stderr}")
+        sys.exit(1)
+    return result.stdout, result.stderr
+
+# runs the out-of-core mode, returns its output and its peak RSS in bytes
+def run_ooc(args, inp):
+    out, err = run(args + ["--alloc-stats"], inp)
+    for line in err.splitlines():
+        if line.startswith("Peak RSS:"):
+            return out, int(line.split()[2])
+    print(f"Error: no peak RSS in the output of {' '.join(args)}: {err}")
+    sys.exit(1)
+
+def main():
+    parser = argparse.ArgumentParser(description="Memory budget check of the out-of-core mode")
+    parser.add_argument("driver", help="path to the Driver binary")
+    parser.add_argument("--budget", type=int, default=20000000, help="memory budget, bytes")
+    parser.add_argument("--shapes", type=int, default=100000, help="number of shapes of the scene")
+    parser.add_argument("--engine", default="auto")
+    args = parser.parse_args()
+
+    ooc = [args.driver, "--out-of-core", "--engine", args.engine]
+    _, base = run_ooc(ooc + ["--mem-budget", "1"], "1\n0 0 0 1 0 0 0 1 0\n")
+
+    scene = gen_scene(args.shapes, 1)
+    out, peak = run_ooc(ooc + ["--mem-budget", str(args.budget)], scene)
+
+    print(f"Base RSS: {base} bytes, peak RSS: {peak} bytes, budget: {args.budget} bytes")
+    if peak > base + args.budget:
+        print(f"Error: peak RSS exceeds the budget by {peak - base - args.budget} bytes")
+        sys.exit(1)
+
+    if out != run([args.driver, "--engine", args.engine], scene)[0]:
+        print("Error: indices differ from the in-memory run")
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
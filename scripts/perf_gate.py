@@ -0,0 +1,105 @@
+import sys
+import json
+import argparse
+import subprocess
+import tempfile
+import os
+
+# Runs a fixed subset of the benchmark binary and compares it with the stored baseline.
+# Stage counters (narrow-phase call counts and so on) are deterministic and are compared
+# exactly; timings depend on the machine and are compared within the given relative
+# tolerance, unless --no-timing is given. The gated benchmarks measure the CPU time of the
+# whole process (MeasureProcessCPUTime, the "/process_time" suffix of their names), so the time
+# of the worker threads is counted as well as that of the main one.
+
+REPETITIONS = 3
+
+def run_benchmark(bench_bin, bench_filter, workdir, repetitions):
+    with tempfile.NamedTemporaryFile(suffix=".json", delete=False) as tmp:
+        out_filename = tmp.name
+
+    try:
+        subprocess.run([bench_bin,
+                        f"--benchmark_filter={bench_filter}",
+                        f"--benchmark_repetitions={repetitions}",
+                        "--benchmark_report_aggregates_only=true",
+                        f"--benchmark_out={out_filename}",
+                        "--benchmark_out_format=json"],
+                       cwd=workdir, stdout=subprocess.DEVNULL, check=True)
+        with open(out_filename, 'r') as file:
+            report = json.load(file)
+    finally:
+        os.remove(out_filename)
+
+    results = {}
+    for bench in report["benchmarks"]:
+        if bench.get("error_occurred"):
+            print(f"Error: benchmark '{bench['run_name']}' failed: {bench.get('error_message')}")
+            sys.exit(1)
+        # one repetition has no aggregates, its only run is the result
+        if repetitions > 1 and bench.get("aggregate_name") != "median":
+            continue
+
+        counters = {key: value for key, value in bench.items() if key.startswith("narrow_")
+                                                                  or key in ("intscs", "inds", "midphase")}
+        results[bench["run_name"]] = {"cpu_time_ns": bench["cpu_time"], "counters": counters}
+    return results
+
+def main():
+    parser = argparse.ArgumentParser(description="Performance regression gate")
+    parser.add_argument("benchmark", help="path to the benchmark binary")
+    parser.add_argument("baseline", help="path to the baseline json")
+    parser.add_argument("--tolerance", type=float, default=0.3,
+                        help="allowed relative slowdown of cpu time (default: 0.3)")
+    parser.add_argument("--workdir", default=".", help="working directory for the benchmark binary")
+    parser.add_argument("--no-timing", action="store_true",
+                        help="compare only stage counters (e.g. for not optimized builds)")
+    parser.add_argument("--update", action="store_true", help="rewrite the baseline with the current results")
+    args = parser.parse_args()
+
+    with open(args.baseline, 'r') as file:
+        baseline = json.load(file)
+
+    # counters are the same in every run, one is enough without the timing
+    repetitions = 1 if args.no_timing and not args.update else REPETITIONS
+    current = run_benchmark(args.benchmark, baseline["filter"], args.workdir, repetitions)
+
+    if args.update:
+        baseline["benchmarks"] = current
+        with open(args.baseline, 'w') as file:
+            json.dump(baseline, file, indent=4)
+            file.write("\n")
+        print(f"Baseline '{args.baseline}' updated")
+        return
+
+    failed = False
+    for name, base in baseline["benchmarks"].items():
+        if name not in current:
+            print(f"{name}: MISSING from the current run")
+            failed = True
+            continue
+        cur = current[name]
+
+        for counter, base_value in base["counters"].items():
+            cur_value = cur["counters"].get(counter)
+            if cur_value != base_value:
+                print(f"{name}: counter '{counter}' changed: {base_value} -> {cur_value}")
+                failed = True
+
+        if args.no_timing:
+            continue
+        ratio = cur["cpu_time_ns"] / base["cpu_time_ns"]
+        verdict = "ok"
+        if ratio > 1 + args.tolerance:
+            verdict = "SLOWDOWN"
+            failed = True
+        print(f"{name}: cpu time {base['cpu_time_ns'] / 1e6:.1f} ms -> {cur['cpu_time_ns'] / 1e6:.1f} ms "
+              f"(x{ratio:.2f}, tolerance x{1 + args.tolerance:.2f}): {verdict}")
+
+    if failed:
+        print("PERF GATE FAILED!")
+        sys.exit(1)
+    print("PERF GATE OK!")
+
+if __name__ == "__main__":
+    main()
@@ -2,12 +2,13 @@
 
 # If number of arguments less then 2; print usage and exit
 if [ $# -lt 2 ]; then
-    printf "Usage: %s <application> <testname>\n" "$0" >&2
+    printf "Usage: %s <application> <testname> [application args...]\n" "$0" >&2
     exit 1
 fi
 
 bin="$1"           # The application, full path (from command arg)
 file="$2"          # The test file STEM (with full path before it) (from command arg)
+shift 2            # The rest of the command args are passed to the application
 #diff="diff -iad"   # Diff command
 
 # An array, do not have to declare it, but is supposedly faster
@@ -16,6 +17,7 @@ file="$2"          # The test file STEM (with full path before it) (from command
 # Padd file_base with suffixes
 file_in="$file.in"             # The in file
 file_out_val="$file.out"       # The out file to check against
+file_args="$file.args"         # Optional file with args of the application for this test
 #file_out_tst="$file.out.tst"   # The out file from the application
 
 # Validate infile exists (do the same for out validate file)
@@ -29,7 +31,11 @@ if [ ! -f "$file_out_val" ]; then
 fi
 
 # Run application, redirect in file to app, and output to out file
-output=$("$bin" < "$file_in" 2>&1)
+args=()
+if [ -f "$file_args" ]; then
+    read -r -a args < "$file_args"
+fi
+output=$("$bin" "${args[@]}" "$@" < "$file_in" 2>&1)
 expected=$(cat $file_out_val)
 
 # Execute diff
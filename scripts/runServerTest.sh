@@ -0,0 +1,55 @@
+#!/bin/bash
+
+# Loopback test of the scene server: 'Driver --serve' is started on <test>.in, the requests of
+# <test>.req are sent by scene_client.py (with the client args from the optional <test>.args),
+# and the responses are compared with <test>.out. The server is stopped with SHUTDOWN.
+
+if [ $# -lt 2 ]; then
+    printf "Usage: %s <application> <testname>\n" "$0" >&2
+    exit 1
+fi
+
+bin="$1"
+file="$2"
+script_dir=$(dirname "$0")
+
+for suffix in in req out; do
+    if [ ! -f "$file.$suffix" ]; then
+        printf "File %s is missing\n" "$file.$suffix"
+        exit 2
+    fi
+done
+
+args=()
+if [ -f "$file.args" ]; then
+    read -r -a args < "$file.args"
+fi
+
+work_dir=$(mktemp -d)
+sock="$work_dir/scene.sock"
+"$bin" --serve "$sock" < "$file.in" > "$work_dir/server.out" 2>&1 &
+server_pid=$!
+trap 'kill $server_pid 2> /dev/null; rm -rf "$work_dir"' EXIT
+
+# the socket appears once the scene is loaded
+for ((i = 0; i < 100; i++)); do
+    [ -S "$sock" ] && break
+    sleep 0.1
+done
+
+output=$(python3 "$script_dir/scene_client.py" "$sock" "${args[@]}" < "$file.req" 2>&1)
+shutdown=$(python3 "$script_dir/scene_client.py" "$sock" SHUTDOWN 2>&1)
+wait $server_pid
+status=$?
+expected=$(cat "$file.out")
+
+if [ "$output" == "$expected" ] && [ "$shutdown" == "OK" ] && [ $status -eq 0 ]; then
+    printf "$file: TEST OK!\n"
+    exit 0
+else
+    printf "$file: TEST FAILED!\n"
+    printf "expected output: <$expected>\n"
+    printf "actual output:   <$output>\n"
+    printf "shutdown: <$shutdown>, server exit status %s: <%s>\n" "$status" "$(cat "$work_dir/server.out")"
+    exit 1
+fi
@@ -0,0 +1,36 @@
+#!/bin/bash
+
+# Runs N 'Driver --shard ID/N' processes on the input from stdin in parallel
+# and merges their outputs with merge_shards.sh
+
+if [ $# -lt 2 ]; then
+    printf "Usage: %s <Driver> <N_shards> [Driver args...] < input\n" "$0" >&2
+    exit 1
+fi
+
+bin="$1"
+n_shards="$2"
+shift 2
+
+script_dir=$(dirname "$0")
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+cat > "$work_dir/input"
+
+pids=()
+for ((id = 0; id < n_shards; id++)); do
+    "$bin" --shard "$id/$n_shards" "$@" < "$work_dir/input" > "$work_dir/shard_$id.out" 2> "$work_dir/shard_$id.err" &
+    pids+=($!)
+done
+
+status=0
+for pid in "${pids[@]}"; do
+    wait "$pid" || status=1
+done
+
+# every shard reads the whole input, so input errors are reported by all of them
+cat "$work_dir"/shard_*.err | sort -u >&2
+
+"$script_dir/merge_shards.sh" "$work_dir"/shard_*.out
+exit $status
@@ -0,0 +1,71 @@
+import sys
+import socket
+import argparse
+import threading
+
+# Client of 'Driver --serve SOCKET': sends request lines (from the arguments or from stdin,
+# one per line) over the Unix socket and prints the response to every one of them.
+# With --clients N the requests are sent over N concurrent connections, and the responses
+# of all of them must be the same (for read-only requests).
+
+class SceneClient:
+    def __init__(self, path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path)
+        self.file = self.sock.makefile('rw', newline='\n')
+
+    def request(self, line):
+        self.file.write(line + '\n')
+        self.file.flush()
+        response = self.file.readline()
+        if not response:
+            raise ConnectionError("Server closed the connection")
+        return response.rstrip('\n')
+
+    def close(self):
+        self.file.close()
+        self.sock.close()
+
+def run_requests(path, requests):
+    client = SceneClient(path)
+    try:
+        return [client.request(line) for line in requests]
+    finally:
+        client.close()
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("socket")
+    parser.add_argument("requests", nargs="*", help="request lines, stdin if none")
+    parser.add_argument("--clients", type=int, default=1)
+    args = parser.parse_args()
+
+    requests = args.requests or [line.rstrip('\n') for line in sys.stdin if line.strip()]
+
+    results = [None] * args.clients
+    errors = []
+    def work(k):
+        try:
+            results[k] = run_requests(args.socket, requests)
+        except Exception as err:
+            errors.append(err)
+
+    threads = [threading.Thread(target=work, args=(k,)) for k in range(args.clients)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    if errors:
+        print(f"Request failed: {errors[0]}", file=sys.stderr)
+        return 1
+    if any(result != results[0] for result in results):
+        print("Concurrent clients got different responses", file=sys.stderr)
+        return 1
+
+    for response in results[0]:
+        print(response)
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,162 @@
+#include "alloc_stats.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+
+#include <malloc.h>
+
+namespace Driver
+{
+
+namespace Alloc
+{
+
+namespace
+{
+
+std::atomic<bool> enabled{false};
+std::atomic<size_t> n_allocs{0}, n_bytes{0};
+// usable sizes of the blocks; blocks allocated before reset() may be freed after it,
+// so the heap in use is counted relative to reset() and may go below zero
+std::atomic<int64_t> in_use{0}, peak_in_use{0};
+
+} // anonymous namespace
+
+void enable(bool on)
+{
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+Counters counters()
+{
+    return {n_allocs.load(std::memory_order_relaxed), n_bytes.load(std::memory_order_relaxed),
+            peak_in_use.load(std::memory_order_relaxed), in_use.load(std::memory_order_relaxed)};
+}
+
+void reset()
+{
+    n_allocs.store(0, std::memory_order_relaxed);
+    n_bytes.store(0, std::memory_order_relaxed);
+    in_use.store(0, std::memory_order_relaxed);
+    peak_in_use.store(0, std::memory_order_relaxed);
+}
+
+size_t peak_rss()
+{
+    std::ifstream status("/proc/self/status");
+    std::string key;
+    size_t kbytes = 0;
+    while (status >> key)
+    {
+        if (key == "VmHWM:" && status >> kbytes)
+            return kbytes << 10;
+        status.ignore(1 << 10, '\n');
+    }
+    return 0;
+}
+
+void reset_peak_rss()
+{
+    // "5" resets the peak RSS of the process to its current RSS
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+}
+
+namespace
+{
+
+void on_alloc(void *ptr, size_t size)
+{
+    if (!ptr || !enabled.load(std::memory_order_relaxed))
+        return;
+    n_allocs.fetch_add(1, std::memory_order_relaxed);
+    n_bytes.fetch_add(size, std::memory_order_relaxed);
+
+    int64_t usable = malloc_usable_size(ptr);
+    int64_t now = in_use.fetch_add(usable, std::memory_order_relaxed) + usable;
+    int64_t peak = peak_in_use.load(std::memory_order_relaxed);
+    while (now > peak && !peak_in_use.compare_exchange_weak(peak, now, std::memory_order_relaxed))
+        ;
+}
+
+void on_free(void *ptr)
+{
+    if (ptr && enabled.load(std::memory_order_relaxed))
+        in_use.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+}
+
+const size_t DEFAULT_ALIGN = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+void *alloc(size_t size, size_t align)
+{
+    if (size == 0)
+        size = 1;
+    void *ptr = nullptr;
+    if (align > DEFAULT_ALIGN)
+        ptr = std::aligned_alloc(align, (size + align - 1) / align * align);
+    else
+        ptr = std::malloc(size);
+    on_alloc(ptr, size);
+    return ptr;
+}
+
+void *alloc_or_throw(size_t size, size_t align)
+{
+    void *ptr = nullptr;
+    while (!(ptr = alloc(size, align)))
+    {
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+    return ptr;
+}
+
+void dealloc(void *ptr)
+{
+    on_free(ptr);
+    std::free(ptr);
+}
+
+} // anonymous namespace
+
+} // namespace Alloc
+
+} // namespace Driver
+
+using Driver::Alloc::alloc;
+using Driver::Alloc::alloc_or_throw;
+using Driver::Alloc::dealloc;
+using Driver::Alloc::DEFAULT_ALIGN;
+
+void *operator new(size_t size)                                       {return alloc_or_throw(size, DEFAULT_ALIGN);}
+void *operator new[](size_t size)                                     {return alloc_or_throw(size, DEFAULT_ALIGN);}
+void *operator new(size_t size, const std::nothrow_t &) noexcept      {return alloc(size, DEFAULT_ALIGN);}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept    {return alloc(size, DEFAULT_ALIGN);}
+void *operator new(size_t size, std::align_val_t align)               {return alloc_or_throw(size, static_cast<size_t>(align));}
+void *operator new[](size_t size, std::align_val_t align)             {return alloc_or_throw(size, static_cast<size_t>(align));}
+void *operator new(size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    return alloc(size, static_cast<size_t>(align));
+}
+void *operator new[](size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    return alloc(size, static_cast<size_t>(align));
+}
+
+void operator delete(void *ptr) noexcept                                        {dealloc(ptr);}
+void operator delete[](void *ptr) noexcept                                      {dealloc(ptr);}
+void operator delete(void *ptr, size_t) noexcept                                {dealloc(ptr);}
+void operator delete[](void *ptr, size_t) noexcept                              {dealloc(ptr);}
+void operator delete(void *ptr, const std::nothrow_t &) noexcept                {dealloc(ptr);}
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept              {dealloc(ptr);}
+void operator delete(void *ptr, std::align_val_t) noexcept                      {dealloc(ptr);}
+void operator delete[](void *ptr, std::align_val_t) noexcept                    {dealloc(ptr);}
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept              {dealloc(ptr);}
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept            {dealloc(ptr);}
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept   {dealloc(ptr);}
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {dealloc(ptr);}
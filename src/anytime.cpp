@@ -0,0 +1,167 @@
+#include "anytime.hpp"
+#include "lbvh.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <tuple>
+
+namespace Driver
+{
+
+namespace Anytime
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+// pair of LBVH nodes, the overlap of their boxes bounds the overlaps of all pairs of leaves below;
+// a == b stands for all pairs of different leaves of the node
+struct NodePair
+{
+    double volume; // of the overlap of the boxes
+    double extent; // sum of the sides of the overlap, orders flat overlaps of zero volume
+    LBVH::node_t a, b;
+
+    // max-heap order: the biggest overlap first, then the smallest nodes for determinism
+    bool operator<(const NodePair &rhs) const
+    {
+        return std::tie(volume, extent, rhs.a, rhs.b) < std::tie(rhs.volume, rhs.extent, a, b);
+    }
+};
+
+NodePair make_node_pair(const LBVH &bvh, LBVH::node_t a, LBVH::node_t b)
+{
+    const Geom::BoundingBox &box_a = bvh.node_box(a), &box_b = bvh.node_box(b);
+    Geom::Point3D min_a = box_a.min(), max_a = box_a.max(), min_b = box_b.min(), max_b = box_b.max();
+    double sides[3] = {std::min(max_a.x(), max_b.x()) - std::max(min_a.x(), min_b.x()),
+                       std::min(max_a.y(), max_b.y()) - std::max(min_a.y(), min_b.y()),
+                       std::min(max_a.z(), max_b.z()) - std::max(min_a.z(), min_b.z())};
+    // boxes may only touch within the tolerance
+    for (auto &side : sides)
+        side = std::max(side, 0.0);
+    return {sides[0] * sides[1] * sides[2], sides[0] + sides[1] + sides[2], a, b};
+}
+
+// the deadline is checked once per this many pairs taken from the queue
+const size_t CHECK_PERIOD = 256;
+
+// marks the leaves below the node, every subtree is visited once
+void mark_leaves(const LBVH &bvh, LBVH::node_t node, std::vector<bool> &visited, std::vector<bool> &leaves)
+{
+    std::vector<LBVH::node_t> stack{node};
+    while (!stack.empty())
+    {
+        node = stack.back();
+        stack.pop_back();
+        if (node & LBVH::LEAF_FLAG)
+            leaves[node & ~LBVH::LEAF_FLAG] = true;
+        else if (!visited[node])
+        {
+            visited[node] = true;
+            auto [left, right] = bvh.children(node);
+            stack.push_back(left);
+            stack.push_back(right);
+        }
+    }
+}
+
+} // anonymous namespace
+
+Report get_inds_with_intscs(ListPoint3D &points, ListLineSeg3D &linesegs, ListTriangle3D &triangles,
+                            const Params &params, const std::function<void(index_t)> &on_found,
+                            Stats *stats)
+{
+    using node_t = LBVH::node_t;
+    Clock::time_point deadline = Clock::now() + params.budget;
+    Report report;
+    Stats st;
+
+    ShapeArray arr = make_shape_array(points, linesegs, triangles);
+    size_t n = arr.size();
+    LBVH bvh{std::vector<Geom::BoundingBox>(arr.boxes.begin(), arr.boxes.end())};
+
+    std::vector<bool> found(n); // by leaf
+    auto confirm = [&](node_t leaf)
+    {
+        if (!found[leaf])
+        {
+            found[leaf] = true;
+            on_found(arr.inds[bvh.leaf_item(leaf)]);
+        }
+    };
+
+    std::priority_queue<NodePair> queue;
+    auto push = [&](node_t a, node_t b)
+    {
+        if (a == b ? !(a & LBVH::LEAF_FLAG) : bvh.node_box(a).intersects(bvh.node_box(b)))
+            queue.push(make_node_pair(bvh, a, b));
+    };
+    if (n)
+        push(bvh.root(), bvh.root());
+
+    auto extent = [&bvh](node_t node)
+    {
+        Geom::Vector3D diag = bvh.node_box(node).max() - bvh.node_box(node).min();
+        return diag.x() + diag.y() + diag.z();
+    };
+
+    size_t n_popped = 0;
+    while (!queue.empty())
+    {
+        if (n_popped++ % CHECK_PERIOD == 0 && Clock::now() >= deadline)
+            break;
+
+        auto [volume, ext, a, b] = queue.top();
+        queue.pop();
+
+        if (a == b)
+        {
+            auto [left, right] = bvh.children(a);
+            push(left, left);
+            push(right, right);
+            push(left, right);
+        }
+        else if ((a & LBVH::LEAF_FLAG) && (b & LBVH::LEAF_FLAG))
+        {
+            node_t leaf_a = a & ~LBVH::LEAF_FLAG, leaf_b = b & ~LBVH::LEAF_FLAG;
+            report.n_checked++;
+            if (found[leaf_a] && found[leaf_b])
+                continue;
+            if (intersects(arr.shapes[bvh.leaf_item(leaf_a)], arr.shapes[bvh.leaf_item(leaf_b)], st))
+            {
+                confirm(leaf_a);
+                confirm(leaf_b);
+            }
+        }
+        else
+        {
+            // the bigger of two nodes is split
+            bool split_a = !(a & LBVH::LEAF_FLAG) && ((b & LBVH::LEAF_FLAG) || extent(a) >= extent(b));
+            auto [left, right] = bvh.children(split_a ? a : b);
+            push(split_a ? left : a, split_a ? b : left);
+            push(split_a ? right : a, split_a ? b : right);
+        }
+    }
+    report.complete = queue.empty();
+
+    // the rest of the queue is the unchecked part of the candidate space
+    std::vector<bool> visited(n ? n - 1 : 0), unchecked(n);
+    for (; !queue.empty(); queue.pop())
+    {
+        mark_leaves(bvh, queue.top().a, visited, unchecked);
+        mark_leaves(bvh, queue.top().b, visited, unchecked);
+    }
+    for (size_t leaf = 0; leaf < n; leaf++)
+        if (unchecked[leaf] && !found[leaf])
+            report.unchecked.push_back(arr.inds[bvh.leaf_item(leaf)]);
+    std::sort(report.unchecked.begin(), report.unchecked.end());
+
+    if (stats) *stats = st;
+    return report;
+}
+
+} // namespace Anytime
+
+} // namespace Driver
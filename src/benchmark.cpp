@@ -2,9 +2,42 @@
 
 #include <iostream>
 #include <fstream>
+#include <atomic>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
 
 #include "triangles.hpp"
 #include "driver.hpp"
+#include "alloc_stats.hpp"
+#include "lbvh.hpp"
+#include "bvh8.hpp"
+
+// counts allocations of the separate run done by the library with the manager registered:
+// allocs_per_iter, total_allocated_bytes and max_bytes_used (peak of the heap in use) in the report
+class AllocMemoryManager : public benchmark::MemoryManager
+{
+public:
+    void Start() override
+    {
+        Driver::Alloc::reset();
+        Driver::Alloc::enable(true);
+    }
+
+    void Stop(Result &result) override
+    {
+        Driver::Alloc::enable(false);
+        Driver::Alloc::Counters cnt = Driver::Alloc::counters();
+        result.num_allocs = cnt.allocs;
+        result.total_allocated_bytes = cnt.bytes;
+        result.max_bytes_used = cnt.peak;
+        result.net_heap_growth = cnt.growth;
+    }
+
+    // older versions of the library have only this one as pure virtual
+    void Stop(Result *result) {Stop(*result);}
+};
 
 template <class ...Args>
 void BM(benchmark::State &state, Args&&... args)
@@ -12,6 +45,12 @@ void BM(benchmark::State &state, Args&&... args)
     //benchmark arg setup
     auto args_tuple = std::make_tuple(std::forward<Args>(args)...);
     std::string bench_data_filename = std::get<0>(args_tuple); 
+    bool morton = false; // reorder shapes by Morton code before the tests
+    if constexpr (sizeof...(Args) > 1)
+        morton = std::get<1>(args_tuple);
+    Driver::Engine engine = Driver::Engine::BruteForce;
+    if constexpr (sizeof...(Args) > 2)
+        engine = std::get<2>(args_tuple);
 
     //setup
     size_t cache_size = 0, queries_cnt = 0;
@@ -25,8 +64,13 @@ void BM(benchmark::State &state, Args&&... args)
 
     for (auto _ : state)
     {
-        //this code is timed
         using namespace Driver;
+        // peak RSS goes through /proc, out of the timing
+        state.PauseTiming();
+        Alloc::reset_peak_rss();
+        state.ResumeTiming();
+
+        //this code is timed
 
         std::vector<double> inp;
         get_input(inp, file);
@@ -35,29 +79,160 @@ void BM(benchmark::State &state, Args&&... args)
         ListLineSeg3D linesegs;
         ListTriangle3D triangles;
         parse_input(points, linesegs, triangles, inp);
+        if (morton)
+            reorder_morton(points, linesegs, triangles);
 
         std::cout << "Points: " << points.size() << std::endl;
         std::cout << "Line segments: " << linesegs.size() << std::endl;
         std::cout << "Triangles: " << triangles.size() << std::endl;
         
-        std::set<index_t> indcs = get_inds_with_intscs(points, linesegs, triangles);
+        Stats stats;
+        std::set<index_t> indcs = get_inds_with_intscs(points, linesegs, triangles, engine, &stats);
 
         for (auto ind : indcs)
         {
             std::cout << ind << std::endl;
         }
 
+        state.PauseTiming();
         file.clear();
         file.seekg(0, std::ios::beg);
+
+        // stage counters are deterministic, so they are checked exactly by scripts/perf_gate.py
+        state.counters["narrow_pt_pt"] = stats.pt_pt;
+        state.counters["narrow_pt_ls"] = stats.pt_ls;
+        state.counters["narrow_pt_tr"] = stats.pt_tr;
+        state.counters["narrow_ls_ls"] = stats.ls_ls;
+        state.counters["narrow_ls_tr"] = stats.ls_tr;
+        state.counters["narrow_tr_tr"] = stats.tr_tr;
+        state.counters["narrow_calls"] = stats.narrow_calls();
+        state.counters["intscs"]       = stats.intscs;
+        state.counters["midphase"]     = stats.midphase;
+        state.counters["inds"]         = indcs.size();
+        state.counters["peak_rss"]     = Alloc::peak_rss();
+        state.ResumeTiming();
     }
 }
 
+// CPU time of the process: the engines run on the threads of Parallel, not only on the main one
+
 //BENCHMARK_CAPTURE(BM, full_rand_10000, std::string("benchmark_data/full_rand_10000.dat"));
 
-BENCHMARK_CAPTURE(BM, set_trs_10000, std::string("benchmark_data/set_trs_10000.dat"));
+BENCHMARK_CAPTURE(BM, set_trs_10000, std::string("benchmark_data/set_trs_10000.dat"))->MeasureProcessCPUTime();
+
+BENCHMARK_CAPTURE(BM, set_trs_10000_morton, std::string("benchmark_data/set_trs_10000.dat"), true)->MeasureProcessCPUTime();
+
+BENCHMARK_CAPTURE(BM, set_trs_10000_tiled, std::string("benchmark_data/set_trs_10000.dat"), false, Driver::Engine::Tiled)->MeasureProcessCPUTime();
+
+BENCHMARK_CAPTURE(BM, set_trs_10000_lbvh, std::string("benchmark_data/set_trs_10000.dat"), false, Driver::Engine::LBVH)->MeasureProcessCPUTime();
+
+BENCHMARK_CAPTURE(BM, set_trs_10000_lbvh18, std::string("benchmark_data/set_trs_10000.dat"), false, Driver::Engine::LBVH18)->MeasureProcessCPUTime();
+
+BENCHMARK_CAPTURE(BM, set_trs_10000_bvh8, std::string("benchmark_data/set_trs_10000.dat"), false, Driver::Engine::BVH8)->MeasureProcessCPUTime();
 
-BENCHMARK_CAPTURE(BM, set_trs_10000_1000_10, std::string("benchmark_data/set_trs_10000_1000_10.dat"));
+BENCHMARK_CAPTURE(BM, set_trs_10000_1000_10, std::string("benchmark_data/set_trs_10000_1000_10.dat"))->MeasureProcessCPUTime();
 
-BENCHMARK_CAPTURE(BM, set_pts_100000, std::string("benchmark_data/set_pts_100000.dat"));
+BENCHMARK_CAPTURE(BM, set_trs_10000_1000_10_tiled, std::string("benchmark_data/set_trs_10000_1000_10.dat"), false, Driver::Engine::Tiled)->MeasureProcessCPUTime();
 
-BENCHMARK_MAIN();
\ No newline at end of file
+// narrow_calls of the two show how many candidate pairs 18-DOPs reject compared with boxes
+BENCHMARK_CAPTURE(BM, set_trs_10000_1000_10_lbvh, std::string("benchmark_data/set_trs_10000_1000_10.dat"), false, Driver::Engine::LBVH)->MeasureProcessCPUTime();
+
+BENCHMARK_CAPTURE(BM, set_trs_10000_1000_10_lbvh18, std::string("benchmark_data/set_trs_10000_1000_10.dat"), false, Driver::Engine::LBVH18)->MeasureProcessCPUTime();
+
+BENCHMARK_CAPTURE(BM, set_trs_10000_1000_10_bvh8, std::string("benchmark_data/set_trs_10000_1000_10.dat"), false, Driver::Engine::BVH8)->MeasureProcessCPUTime();
+
+BENCHMARK_CAPTURE(BM, set_pts_100000, std::string("benchmark_data/set_pts_100000.dat"))->MeasureProcessCPUTime();
+
+// boxes of n random shapes of size 1 in a cube where every one overlaps a few others,
+// so that the number of candidate pairs grows linearly and the tree outgrows the caches
+std::vector<Geom::BoundingBox> random_boxes(size_t n)
+{
+    std::mt19937_64 gen{1};
+    double side = std::cbrt(static_cast<double>(n)) * 2;
+    std::uniform_real_distribution<double> coord{0, side}, size{0, 1};
+    std::vector<Geom::BoundingBox> boxes;
+    boxes.reserve(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        Geom::Point3D p{coord(gen), coord(gen), coord(gen)};
+        boxes.push_back(Geom::BoundingBox{p, Geom::Point3D{p.x() + size(gen), p.y() + size(gen), p.z() + size(gen)}});
+    }
+    return boxes;
+}
+
+// traversal only: LBVH over random_boxes(n) queried with the same boxes in random order,
+// like queries of shapes of another scene; state.range(1) is the interleaved traversal
+void BM_traversal(benchmark::State &state)
+{
+    size_t n = state.range(0);
+    bool interleaved = state.range(1);
+    std::vector<Geom::BoundingBox> boxes = random_boxes(n);
+    Driver::LBVH bvh{boxes};
+    std::shuffle(boxes.begin(), boxes.end(), std::mt19937_64{2});
+
+    const size_t BLOCK = 1024;
+    for (auto _ : state)
+    {
+        std::atomic<size_t> hits{0};
+        Driver::Parallel::for_each((n + BLOCK - 1) / BLOCK, 1, [&](size_t, size_t block)
+        {
+            size_t begin = block * BLOCK, cnt = std::min(n, begin + BLOCK) - begin, block_hits = 0;
+            if (interleaved)
+                bvh.query_interleaved(cnt, [&](size_t query) -> const Geom::BoundingBox & {return boxes[begin + query];},
+                                      [&](size_t, size_t) {block_hits++;});
+            else
+                for (size_t query = 0; query < cnt; query++)
+                    bvh.query(boxes[begin + query], [&](size_t) {block_hits++;});
+            hits.fetch_add(block_hits, std::memory_order_relaxed);
+        });
+        state.counters["hits"] = hits.load();
+    }
+}
+
+BENCHMARK(BM_traversal)->ArgsProduct({{1 << 13, 1 << 16, 1 << 19, 1 << 22}, {0, 1}})->Unit(benchmark::kMillisecond);
+
+// traversal only, the self-intersection query of the engines over random_boxes(n): every leaf
+// against the leaves after it. state.range(1) is 0 for the LBVH, 1 for the BVH8 queried leaf by
+// leaf, 2 for the BVH8 queried by packets of leaves
+void BM_self_pairs(benchmark::State &state)
+{
+    size_t n = state.range(0);
+    int variant = state.range(1);
+    std::vector<Geom::BoundingBox> boxes = random_boxes(n);
+    Driver::LBVH lbvh{boxes};
+    Driver::BVH8 bvh8{boxes};
+
+    const size_t GRAIN = 64;
+    for (auto _ : state)
+    {
+        std::vector<size_t> thread_hits(Driver::Parallel::n_threads());
+        if (variant == 0)
+            Driver::Parallel::for_each(n, GRAIN, [&](size_t thr, size_t leaf)
+            {
+                lbvh.query(lbvh.leaf_box(leaf), [&](size_t other) {thread_hits[thr] += other != leaf;}, leaf);
+            });
+        else if (variant == 1)
+            Driver::Parallel::for_each(n, GRAIN, [&](size_t thr, size_t leaf)
+            {
+                bvh8.query(bvh8.leaf_box(leaf), [&](size_t other) {thread_hits[thr] += other != leaf;}, leaf);
+            });
+        else
+            bvh8.query_self_pairs([&](size_t thr, size_t, size_t) {thread_hits[thr]++;});
+        state.counters["hits"] = std::accumulate(thread_hits.begin(), thread_hits.end(), size_t{0});
+    }
+}
+
+BENCHMARK(BM_self_pairs)->ArgsProduct({{1 << 13, 1 << 16, 1 << 19, 1 << 22}, {0, 1, 2}})->Unit(benchmark::kMillisecond);
+
+int main(int argc, char **argv)
+{
+    AllocMemoryManager memory_manager;
+    benchmark::RegisterMemoryManager(&memory_manager);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,292 @@
+#include "bvh8.hpp"
+#include "union_find.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+namespace Driver
+{
+
+namespace
+{
+
+// floats below and above x: the nearest float is off by at most half its ulp, one relative
+// FLT_EPSILON is at least the ulp, FLT_MIN covers the subnormals; out of the float range they are
+// the largest float or infinity. No call of nextafter, these are on the path of every query
+float round_down(double x)
+{
+    if (x >= FLT_MAX) return FLT_MAX;
+    if (x < -FLT_MAX) return -INFINITY;
+    float f = static_cast<float>(x);
+    return f - std::fabs(f) * FLT_EPSILON - FLT_MIN;
+}
+
+float round_up(double x)
+{
+    if (x <= -FLT_MAX) return -FLT_MAX;
+    if (x > FLT_MAX) return INFINITY;
+    float f = static_cast<float>(x);
+    return f + std::fabs(f) * FLT_EPSILON + FLT_MIN;
+}
+
+double surface(const Geom::BoundingBox &box)
+{
+    Geom::Point3D lo = box.min(), hi = box.max();
+    double dx = hi.x() - lo.x(), dy = hi.y() - lo.y(), dz = hi.z() - lo.z();
+    return dx * dy + dy * dz + dz * dx;
+}
+
+using node_t = LBVH::node_t;
+
+// fills node with the children of the internal node bin_node of the LBVH, whose leaves start with
+// first_leaf: the internal child with the biggest surface is replaced by its children in place
+// (so they stay in the order of the leaves) while there is room, then subtrees of up to
+// LEAF_RANGE leaves become leaf ranges. Every other child is a node of its own,
+// add_child(bin_child, first_leaf) returns its index.
+template <typename F>
+void collapse(const LBVH &bvh, node_t bin_node, uint32_t first_leaf, BVH8::Node &node, F &&add_child)
+{
+    const size_t WIDTH = BVH8::WIDTH;
+    node_t slots[WIDTH];
+    double surfaces[WIDTH];
+    size_t n_slots = 2;
+    auto slot_surface = [&](node_t slot) {return (slot & LBVH::LEAF_FLAG) ? -1 : surface(bvh.node_box(slot));};
+    std::tie(slots[0], slots[1]) = bvh.children(bin_node);
+    surfaces[0] = slot_surface(slots[0]);
+    surfaces[1] = slot_surface(slots[1]);
+    while (n_slots < WIDTH)
+    {
+        size_t best = std::max_element(surfaces, surfaces + n_slots) - surfaces;
+        if (slots[best] & LBVH::LEAF_FLAG)
+            break;
+        std::copy_backward(slots + best + 1, slots + n_slots, slots + n_slots + 1);
+        std::copy_backward(surfaces + best + 1, surfaces + n_slots, surfaces + n_slots + 1);
+        std::tie(slots[best], slots[best + 1]) = bvh.children(slots[best]);
+        surfaces[best] = slot_surface(slots[best]);
+        surfaces[best + 1] = slot_surface(slots[best + 1]);
+        n_slots++;
+    }
+
+    for (size_t i = 0; i < WIDTH; i++)
+    {
+        if (i >= n_slots)
+        {
+            for (int axis = 0; axis < 3; axis++)
+                node.min[axis][i] = node.max[axis][i] = std::numeric_limits<float>::quiet_NaN();
+            node.child[i] = node.last_leaf[i] = 0;
+            continue;
+        }
+
+        Geom::Point3D lo = bvh.node_box(slots[i]).min(), hi = bvh.node_box(slots[i]).max();
+        double box_min[3] = {lo.x(), lo.y(), lo.z()}, box_max[3] = {hi.x(), hi.y(), hi.z()};
+        for (int axis = 0; axis < 3; axis++)
+        {
+            node.min[axis][i] = round_down(box_min[axis]);
+            node.max[axis][i] = round_up(box_max[axis]);
+        }
+        node.last_leaf[i] = bvh.last_leaf(slots[i]);
+        node.child[i] = (node.last_leaf[i] - first_leaf < BVH8::LEAF_RANGE) ? (first_leaf | BVH8::LEAF_FLAG)
+                                                                            : add_child(slots[i], first_leaf);
+        first_leaf = node.last_leaf[i] + 1;
+    }
+}
+
+} // anonymous namespace
+
+// BoundingBox::intersects tests min - max < DBL_PRECISION along every axis, so the query box
+// widened by 2 * DBL_PRECISION (rounding of the sum included) and rounded outwards passes every
+// node that the exact test would pass
+BVH8::QueryBox::QueryBox(const Geom::BoundingBox &box)
+{
+    Geom::Point3D lo = box.min(), hi = box.max();
+    double box_min[3] = {lo.x(), lo.y(), lo.z()}, box_max[3] = {hi.x(), hi.y(), hi.z()};
+    for (int axis = 0; axis < 3; axis++)
+    {
+        std::fill_n(min[axis], 4, round_down(box_min[axis] - 2 * Geom::DBL_PRECISION));
+        std::fill_n(max[axis], 4, round_up(box_max[axis] + 2 * Geom::DBL_PRECISION));
+    }
+}
+
+BVH8::BVH8(const LBVH &bvh)
+{
+    size_t n = bvh.size();
+    std::vector<Geom::BoundingBox> leaf_boxes(n, Geom::BoundingBox{Geom::Point3D{0, 0, 0}});
+    std::vector<uint32_t> leaf_items(n);
+    Parallel::for_blocks(n, [&](size_t, size_t begin, size_t end)
+    {
+        for (size_t leaf = begin; leaf < end; leaf++)
+        {
+            leaf_boxes[leaf] = bvh.leaf_box(leaf);
+            leaf_items[leaf] = bvh.leaf_item(leaf);
+        }
+    });
+    leaf_boxes_ = Storage<Geom::BoundingBox>{std::move(leaf_boxes)};
+    leaf_items_ = Storage<uint32_t>{std::move(leaf_items)};
+    if (n <= 1)
+        return;
+
+    // internal nodes of the LBVH with their first leaves and the nodes they are collapsed into
+    struct Task
+    {
+        node_t bin_node;
+        uint32_t first_leaf, node;
+    };
+
+    // the top is collapsed breadth first until there are enough subtrees for the threads
+    std::vector<Node> nodes(1);
+    std::vector<Task> tasks{{bvh.root(), 0, 0}}, next;
+    const size_t TASKS_PER_THREAD = 16;
+    while (!tasks.empty() && tasks.size() < TASKS_PER_THREAD * Parallel::n_threads())
+    {
+        next.clear();
+        for (const Task &task : tasks)
+        {
+            Node node;
+            collapse(bvh, task.bin_node, task.first_leaf, node, [&](node_t bin_child, uint32_t first_leaf)
+            {
+                uint32_t child = nodes.size();
+                nodes.emplace_back();
+                next.push_back({bin_child, first_leaf, child});
+                return child;
+            });
+            nodes[task.node] = node;
+        }
+        tasks.swap(next);
+    }
+
+    // subtrees are collapsed in parallel with their own numbering, the root of every subtree takes
+    // the node reserved for it and the rest are appended in the order of the subtrees
+    std::vector<std::vector<Node>> subtrees(tasks.size());
+    Parallel::for_each(tasks.size(), 1, [&](size_t, size_t task)
+    {
+        std::vector<Node> &sub = subtrees[task];
+        std::vector<Task> stack{{tasks[task].bin_node, tasks[task].first_leaf, 0}};
+        sub.emplace_back();
+        while (!stack.empty())
+        {
+            Task cur = stack.back();
+            stack.pop_back();
+            Node node;
+            collapse(bvh, cur.bin_node, cur.first_leaf, node, [&](node_t bin_child, uint32_t first_leaf)
+            {
+                uint32_t child = sub.size();
+                sub.emplace_back();
+                stack.push_back({bin_child, first_leaf, child});
+                return child;
+            });
+            sub[cur.node] = node;
+        }
+    });
+
+    std::vector<size_t> offsets(tasks.size());
+    size_t n_nodes = nodes.size();
+    for (size_t task = 0; task < tasks.size(); task++)
+    {
+        offsets[task] = n_nodes - 1;
+        n_nodes += subtrees[task].size() - 1;
+    }
+    nodes.resize(n_nodes);
+    Parallel::for_each(tasks.size(), 1, [&](size_t, size_t task)
+    {
+        std::vector<Node> &sub = subtrees[task];
+        for (size_t i = 0; i < sub.size(); i++)
+        {
+            Node &node = nodes[i ? offsets[task] + i : tasks[task].node];
+            node = sub[i];
+            // 0 is an empty slot, the root is never a child
+            for (uint32_t &child : node.child)
+                if (child && !(child & LEAF_FLAG))
+                    child += offsets[task];
+        }
+        std::vector<Node>().swap(sub);
+    });
+    nodes_ = Storage<Node>{std::move(nodes)};
+}
+
+namespace
+{
+
+BVH8 build(const ShapeArray &arr)
+{
+    return BVH8{std::vector<Geom::BoundingBox>(arr.boxes.begin(), arr.boxes.end())};
+}
+
+} // anonymous namespace
+
+std::set<index_t> get_inds_with_intscs_bvh8(const ShapeArray &arr, const BVH8 &bvh, Stats *stats,
+                                            UnionFind *components)
+{
+    size_t n = arr.size();
+    std::vector<std::atomic<bool>> found(n);
+    std::vector<Stats> thread_stats(Parallel::n_threads());
+
+    bvh.query_self_pairs([&](size_t thr, size_t leaf, size_t other_leaf)
+    {
+        size_t item = bvh.leaf_item(leaf), other = bvh.leaf_item(other_leaf);
+        if (intersects(arr.shapes[item], arr.shapes[other], thread_stats[thr]))
+        {
+            found[leaf].store(true, std::memory_order_relaxed);
+            found[other_leaf].store(true, std::memory_order_relaxed);
+            if (components)
+                components->unite(arr.inds[item], arr.inds[other]);
+        }
+    });
+
+    std::set<index_t> indcs;
+    for (size_t leaf = 0; leaf < n; leaf++)
+        if (found[leaf].load(std::memory_order_relaxed))
+            indcs.insert(arr.inds[bvh.leaf_item(leaf)]);
+
+    if (stats)
+    {
+        *stats = Stats{};
+        for (auto &st : thread_stats)
+            *stats += st;
+    }
+    return indcs;
+}
+
+std::set<index_t> get_inds_with_intscs_bvh8(const ShapeArray &arr, Stats *stats, UnionFind *components)
+{
+    return get_inds_with_intscs_bvh8(arr, build(arr), stats, components);
+}
+
+void get_inds_with_cross_intscs_bvh8(const ShapeArray &a, const ShapeArray &b, std::set<index_t> &inds_a,
+                                     std::set<index_t> &inds_b, Stats *stats, UnionFind *components)
+{
+    BVH8 bvh_a = build(a), bvh_b = build(b);
+
+    std::vector<std::atomic<bool>> found_a(a.size()), found_b(b.size());
+    std::vector<Stats> thread_stats(Parallel::n_threads());
+
+    bvh_a.query_pairs(bvh_b, [&](size_t thr, size_t leaf_a, size_t leaf_b)
+    {
+        size_t item_a = bvh_a.leaf_item(leaf_a), item_b = bvh_b.leaf_item(leaf_b);
+        if (intersects(a.shapes[item_a], b.shapes[item_b], thread_stats[thr]))
+        {
+            found_a[leaf_a].store(true, std::memory_order_relaxed);
+            found_b[leaf_b].store(true, std::memory_order_relaxed);
+            if (components)
+                components->unite(a.inds[item_a], b.inds[item_b]);
+        }
+    });
+
+    for (size_t leaf = 0; leaf < a.size(); leaf++)
+        if (found_a[leaf].load(std::memory_order_relaxed))
+            inds_a.insert(a.inds[bvh_a.leaf_item(leaf)]);
+    for (size_t leaf = 0; leaf < b.size(); leaf++)
+        if (found_b[leaf].load(std::memory_order_relaxed))
+            inds_b.insert(b.inds[bvh_b.leaf_item(leaf)]);
+
+    if (stats)
+    {
+        *stats = Stats{};
+        for (auto &st : thread_stats)
+            *stats += st;
+    }
+}
+
+} // namespace Driver
@@ -0,0 +1,90 @@
+/* Smoke test of the C ABI, compiled as C */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "triangles_c.h"
+
+static int n_failed = 0;
+
+#define CHECK(cond)                                                 \
+    do {                                                            \
+        if (!(cond)) {                                              \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            n_failed++;                                             \
+        }                                                           \
+    } while (0)
+
+/* two crossing triangles, a point apart and a segment through both triangles;
+   the 10th number of every shape is a field of the caller, skipped with stride 10 */
+static const double SHAPES[4 * 10] = {
+    0,   0,   0,    2,   0,   0,    0,   2,   0,   -1,
+    1,   1,  -1,    1,   1,   1,    0,   0,   1,   -1,
+    5,   5,   5,    5,   5,   5,    5,   5,   5,   -1,
+    0.5, 0.5, -1,   0.5, 0.5, 1,    0.5, 0.5, 1,   -1
+};
+
+static void test_indices(void)
+{
+    size_t out[4] = {0}, n_out = 0;
+    CHECK(tri_intersecting_indices_d(SHAPES, 4, 10, out, 4, &n_out) == TRI_OK);
+    CHECK(n_out == 3);
+    CHECK(out[0] == 0 && out[1] == 1 && out[2] == 3);
+
+    /* output is cut by capacity, the total number is still returned */
+    size_t first = 42;
+    CHECK(tri_intersecting_indices_d(SHAPES, 4, 10, &first, 1, &n_out) == TRI_OK);
+    CHECK(n_out == 3 && first == 0);
+    CHECK(tri_intersecting_indices_d(SHAPES, 4, 10, NULL, 0, &n_out) == TRI_OK);
+    CHECK(n_out == 3);
+}
+
+static void test_pairs(void)
+{
+    float shapes_f[4 * 9];
+    for (int i = 0; i < 4; i++)
+        for (int k = 0; k < 9; k++)
+            shapes_f[i * 9 + k] = (float)SHAPES[i * 10 + k];
+
+    size_t out[2 * 4] = {0}, n_out = 0;
+    CHECK(tri_intersecting_pairs_f(shapes_f, 4, 9, out, 4, &n_out) == TRI_OK);
+    CHECK(n_out == 3);
+    CHECK(out[0] == 0 && out[1] == 1);
+    CHECK(out[2] == 0 && out[3] == 3);
+    CHECK(out[4] == 1 && out[5] == 3);
+}
+
+static void test_errors(void)
+{
+    size_t out[4], n_out = 0;
+    CHECK(tri_intersecting_indices_d(SHAPES, 4, 8, out, 4, &n_out) == TRI_WRONG_ARGS);
+    CHECK(tri_last_error()[0] != '\0');
+    CHECK(tri_intersecting_indices_d(NULL, 4, 9, out, 4, &n_out) == TRI_WRONG_ARGS);
+    CHECK(tri_intersecting_indices_d(SHAPES, 4, 10, NULL, 4, &n_out) == TRI_WRONG_ARGS);
+
+    double nan_shape[9] = {0, 0, 0, 1, 0, 0, 0, 1, 0};
+    nan_shape[4] = NAN;
+    CHECK(tri_intersecting_indices_d(nan_shape, 1, 9, out, 4, &n_out) == TRI_WRONG_INPUT);
+
+    /* the narrow phase of this pair makes a NaN, thrown from a worker thread */
+    const double huge_pair[2 * 9] = {
+        1e160, 1e160, 1e160,      -1e160, 0, 5e159,       -1e160, 0, 5e159,
+        -1e160, -1e160, -1e160,   1e160, 1e160, 1e160,    1e160, 1e160, 1e160
+    };
+    CHECK(tri_intersecting_pairs_d(huge_pair, 2, 9, out, 2, &n_out) == TRI_WRONG_INPUT);
+    CHECK(tri_last_error()[0] != '\0');
+
+    CHECK(tri_intersecting_indices_d(SHAPES, 0, 9, out, 4, &n_out) == TRI_OK);
+    CHECK(n_out == 0 && tri_last_error()[0] == '\0');
+}
+
+int main(void)
+{
+    test_indices();
+    test_pairs();
+    test_errors();
+
+    if (n_failed)
+        printf("%d checks failed\n", n_failed);
+    return n_failed != 0;
+}
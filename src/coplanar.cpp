@@ -0,0 +1,212 @@
+#include "coplanar.hpp"
+#include "lbvh.hpp"
+#include "parallel.hpp"
+#include "union_find.hpp"
+#include "grid_key.hpp"
+
+#include <unordered_map>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+
+namespace Driver
+{
+
+namespace
+{
+
+using Item = std::pair<index_t, Geom::Triangle3D>;
+
+// normal and offset of a plane in DBL_PRECISION units, rounded
+using PlaneKey = std::array<double, 4>;
+
+struct PlaneKeyHash
+{
+    size_t operator()(const PlaneKey &key) const
+    {
+        uint64_t hash = 0;
+        for (double coord : key)
+            hash = grid_hash(hash, coord);
+        return hash;
+    }
+};
+
+double coord(const Geom::Point3D &p, int axis)
+{
+    return (axis == 0) ? p.x() : (axis == 1) ? p.y() : p.z();
+}
+
+// the normal is turned so that its largest component is positive, then both orientations of
+// a plane get one key; that component is the axis dropped by the projection to 2D
+PlaneKey plane_key(const Geom::Plane &plane, int &drop_axis)
+{
+    Geom::Vector3D n_vec = plane.n_vec();
+    double n[3] = {n_vec.x(), n_vec.y(), n_vec.z()};
+    drop_axis = 0;
+    for (int axis = 1; axis < 3; axis++)
+        if (std::fabs(n[axis]) > std::fabs(n[drop_axis]))
+            drop_axis = axis;
+    if (n[drop_axis] < 0)
+        for (auto &c : n)
+            c = -c;
+
+    Geom::Point3D p = plane.p();
+    double offset = n[0] * p.x() + n[1] * p.y() + n[2] * p.z();
+
+    return {grid_round(n[0]), grid_round(n[1]), grid_round(n[2]), grid_round(offset)};
+}
+
+struct PlaneGroup
+{
+    int drop_axis = 0;
+    std::vector<ListTriangle3D::iterator> members;
+};
+
+std::vector<PlaneGroup> group_by_plane(ListTriangle3D &triangles)
+{
+    std::vector<PlaneGroup> groups;
+    std::unordered_map<PlaneKey, size_t, PlaneKeyHash> group_of;
+    for (auto it = triangles.begin(); it != triangles.end(); it++)
+    {
+        int drop_axis = 0;
+        Geom::Plane plane = it->second.plane();
+        auto [pos, is_new] = group_of.try_emplace(plane_key(plane, drop_axis), groups.size());
+        if (is_new)
+            groups.push_back({drop_axis, {it}});
+        // keys are equal on the grid, the plane must also be equal to the plane of the group
+        else if (groups[pos->second].members.front()->second.plane() == plane)
+            groups[pos->second].members.push_back(it);
+    }
+
+    groups.erase(std::remove_if(groups.begin(), groups.end(),
+                                [](const PlaneGroup &group) {return group.members.size() < 2;}),
+                 groups.end());
+    return groups;
+}
+
+struct Box2D
+{
+    double u_min, u_max, v_min, v_max;
+    size_t item;
+};
+
+// sweep along u over the projected boxes sorted by u_min, the exact test is run for the pairs
+// whose boxes overlap along v too
+void sweep_2d(const std::vector<const Item *> &items, size_t begin, size_t end, int drop_axis,
+              std::vector<std::atomic<bool>> &found, Stats &stats, UnionFind *components)
+{
+    int u_axis = (drop_axis + 1) % 3, v_axis = (drop_axis + 2) % 3;
+    std::vector<Box2D> boxes;
+    boxes.reserve(end - begin);
+    for (size_t item = begin; item < end; item++)
+    {
+        auto &tr = items[item]->second;
+        Geom::Point3D min = tr.bound_box().min(), max = tr.bound_box().max();
+        boxes.push_back({coord(min, u_axis), coord(max, u_axis), coord(min, v_axis), coord(max, v_axis), item});
+    }
+    std::sort(boxes.begin(), boxes.end(), [](const Box2D &lhs, const Box2D &rhs) {return lhs.u_min < rhs.u_min;});
+
+    for (size_t i = 0; i < boxes.size(); i++)
+        for (size_t j = i + 1; j < boxes.size() && Geom::leq(boxes[j].u_min, boxes[i].u_max); j++)
+        {
+            if (!Geom::leq(boxes[j].v_min, boxes[i].v_max) || !Geom::leq(boxes[i].v_min, boxes[j].v_max))
+                continue;
+
+            stats.tr_tr++;
+            size_t a = boxes[i].item, b = boxes[j].item;
+            if (Geom::IntsctTrig3DHelpers::intersects_Triangle2D(items[a]->second, items[b]->second))
+            {
+                stats.intscs++;
+                found[a].store(true, std::memory_order_relaxed);
+                found[b].store(true, std::memory_order_relaxed);
+                if (components)
+                    components->unite(items[a]->first, items[b]->first);
+            }
+        }
+}
+
+} // anonymous namespace
+
+std::set<index_t> get_inds_with_intscs_coplanar(ListPoint3D &points, ListLineSeg3D &linesegs,
+                                                ListTriangle3D &triangles, Engine engine, Stats *stats,
+                                                UnionFind *components)
+{
+    // grouped triangles are moved to their own list, group by group
+    std::vector<PlaneGroup> groups = group_by_plane(triangles);
+    ListTriangle3D grouped;
+    std::vector<const Item *> items;
+    std::vector<uint32_t> item_group;
+    std::vector<size_t> group_begin;
+    for (size_t group = 0; group < groups.size(); group++)
+    {
+        group_begin.push_back(items.size());
+        for (auto it : groups[group].members)
+        {
+            items.push_back(&*it);
+            item_group.push_back(group);
+            grouped.splice(grouped.end(), triangles, it);
+        }
+    }
+    group_begin.push_back(items.size());
+
+    size_t n = items.size();
+    std::vector<std::atomic<bool>> found(n);
+    std::vector<Stats> thread_stats(Parallel::n_threads());
+
+    Parallel::for_each(groups.size(), 1, [&](size_t thr, size_t group)
+    {
+        sweep_2d(items, group_begin[group], group_begin[group + 1], groups[group].drop_axis,
+                 found, thread_stats[thr], components);
+    });
+
+    // grouped triangles of different planes
+    std::vector<index_t> inds;
+    std::vector<Shape> shapes;
+    inds.reserve(n);
+    shapes.reserve(n);
+    for (auto item : items)
+    {
+        inds.push_back(item->first);
+        shapes.emplace_back(item->second);
+    }
+    ShapeArray arr = make_shape_array(std::move(inds), std::move(shapes));
+    LBVH bvh{std::vector<Geom::BoundingBox>(arr.boxes.begin(), arr.boxes.end())};
+    Stats st_groups;
+    std::set<index_t> inds_groups = get_inds_with_intscs_lbvh(arr, bvh, &st_groups, components,
+        [&item_group](size_t item, size_t other) {return item_group[item] == item_group[other];});
+
+    // the rest of the shapes with each other and with the grouped triangles
+    Shapes rest{std::move(points), std::move(linesegs), std::move(triangles)}, coplanar;
+    coplanar.triangles = std::move(grouped);
+
+    Stats st_rest, st_cross;
+    std::set<index_t> indcs = get_inds_with_intscs(rest.points, rest.linesegs, rest.triangles, engine,
+                                                   &st_rest, components);
+    std::set<index_t> inds_rest, inds_coplanar;
+    get_inds_with_cross_intscs(rest, coplanar, inds_rest, inds_coplanar, engine, &st_cross, components);
+
+    indcs.insert(inds_rest.begin(), inds_rest.end());
+    indcs.insert(inds_coplanar.begin(), inds_coplanar.end());
+    indcs.insert(inds_groups.begin(), inds_groups.end());
+    for (size_t item = 0; item < n; item++)
+        if (found[item].load(std::memory_order_relaxed))
+            indcs.insert(items[item]->first);
+
+    points = std::move(rest.points);
+    linesegs = std::move(rest.linesegs);
+    triangles = std::move(rest.triangles);
+    triangles.splice(triangles.end(), coplanar.triangles);
+
+    if (stats)
+    {
+        *stats = st_rest;
+        *stats += st_cross;
+        *stats += st_groups;
+        for (auto &st : thread_stats)
+            *stats += st;
+    }
+    return indcs;
+}
+
+} // namespace Driver
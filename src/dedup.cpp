@@ -0,0 +1,127 @@
+#include "dedup.hpp"
+#include "grid_key.hpp"
+
+#include <unordered_map>
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace Driver
+{
+
+namespace
+{
+
+using GridPoint = std::array<double, 3>;
+
+// coordinates on the grid, overflowed ones are checked by has_grid_key
+GridPoint to_grid(const Geom::Point3D &p)
+{
+    return {grid_round(p.x()), grid_round(p.y()), grid_round(p.z())};
+}
+
+// canonical form of a shape: its kind and sorted grid vertices, unused ones are zero
+struct ShapeKey
+{
+    ShapeKind kind;
+    std::array<GridPoint, 3> verts{};
+
+    bool operator==(const ShapeKey &rhs) const {return kind == rhs.kind && verts == rhs.verts;};
+};
+
+struct ShapeKeyHash
+{
+    size_t operator()(const ShapeKey &key) const
+    {
+        uint64_t hash = static_cast<uint64_t>(key.kind) + 1;
+        for (auto &vert : key.verts)
+            for (double coord : vert)
+                hash = grid_hash(hash, coord);
+        return hash;
+    }
+};
+
+ShapeKey make_key(const Geom::Point3D &point)
+{
+    return {ShapeKind::Point, {to_grid(point)}};
+}
+
+ShapeKey make_key(const Geom::LineSeg3D &ls)
+{
+    ShapeKey key{ShapeKind::LineSeg, {to_grid(ls.p1()), to_grid(ls.p2())}};
+    std::sort(key.verts.begin(), key.verts.begin() + 2);
+    return key;
+}
+
+ShapeKey make_key(const Geom::Triangle3D &tr)
+{
+    ShapeKey key{ShapeKind::Triangle, {to_grid(tr.p1()), to_grid(tr.p2()), to_grid(tr.p3())}};
+    std::sort(key.verts.begin(), key.verts.end());
+    return key;
+}
+
+// distinct shapes with overflowed coordinates would share a key, they are never grouped
+bool has_grid_key(const ShapeKey &key)
+{
+    for (auto &vert : key.verts)
+        for (double coord : vert)
+            if (!std::isfinite(coord))
+                return false;
+    return true;
+}
+
+template <typename List>
+void remove_duplicates(List &shapes, std::vector<DuplicateGroup> &groups)
+{
+    // group of every key, groups of single shapes are dropped at the end
+    std::unordered_map<ShapeKey, size_t, ShapeKeyHash> group_of;
+    group_of.reserve(shapes.size());
+    size_t first_group = groups.size();
+
+    for (auto it = shapes.begin(); it != shapes.end();)
+    {
+        ShapeKey key = make_key(it->second);
+        if (!has_grid_key(key))
+        {
+            ++it;
+            continue;
+        }
+        auto [pos, is_new] = group_of.try_emplace(key, groups.size());
+        if (is_new)
+        {
+            groups.push_back({it->first});
+            ++it;
+        }
+        else
+        {
+            groups[pos->second].push_back(it->first);
+            it = shapes.erase(it);
+        }
+    }
+
+    auto single = std::remove_if(groups.begin() + first_group, groups.end(),
+                                 [](const DuplicateGroup &group) {return group.size() == 1;});
+    groups.erase(single, groups.end());
+}
+
+} // anonymous namespace
+
+std::vector<DuplicateGroup> remove_duplicates(ListPoint3D &points, ListLineSeg3D &linesegs,
+                                              ListTriangle3D &triangles)
+{
+    std::vector<DuplicateGroup> groups;
+    remove_duplicates(points, groups);
+    remove_duplicates(linesegs, groups);
+    remove_duplicates(triangles, groups);
+    return groups;
+}
+
+void restore_duplicates(const std::vector<DuplicateGroup> &groups, std::set<index_t> &indcs,
+                        bool members_intersect)
+{
+    for (auto &group : groups)
+        if (members_intersect || indcs.count(group.front()))
+            indcs.insert(group.begin(), group.end());
+}
+
+} // namespace Driver
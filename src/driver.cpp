@@ -1,6 +1,12 @@
 #include "driver.hpp"
+#include "morton.hpp"
+#include "union_find.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <type_traits>
 
 void Driver::get_input(std::vector<double> &out, std::istream& stream)
 {
@@ -22,126 +28,485 @@ void Driver::get_input(std::vector<double> &out, std::istream& stream)
         throw std::runtime_error("Not full input");
 }
 
+Driver::ShapeKind Driver::classify_shape(Geom::Point3D &p1, Geom::Point3D &p2, Geom::Point3D &p3)
+{
+    using namespace Geom;
+    int eq_cnt = (p1 == p2) + (p2 == p3) + (p1 == p3);
+    if (eq_cnt == 3)
+        return ShapeKind::Point;
+
+    if (eq_cnt == 1)
+    {
+        if (p1 == p2)
+            p2 = p3;
+        return ShapeKind::LineSeg;
+    }
+
+    Vector3D v12 = p2 - p1;
+    Vector3D v13 = p3 - p1;
+    if (!cross_prod(v12, v13).is_zero())
+        return ShapeKind::Triangle;
+
+    scalar_t dot = dot_prod(v12, v13);
+    if (leq(dot, 0))
+        p1 = p3;
+    else if (!leq(dot, v12.len()*v12.len()))
+        p2 = p3;
+    return ShapeKind::LineSeg;
+}
+
+void Driver::parse_shape(index_t ind, const double *coords, ListPoint3D &points_out,
+                         ListLineSeg3D &linesegs_out, ListTriangle3D &triangles_out)
+{
+    using namespace Geom;
+    const double *it = coords;
+    Point3D p1{*it, *(it+1), *(it+2)}, p2{*(it+3), *(it+4), *(it+5)}, p3{*(it+6), *(it+7), *(it+8)};
+    switch (classify_shape(p1, p2, p3))
+    {
+    case ShapeKind::Point:
+        points_out.push_back(std::make_pair(ind, p1));
+        break;
+    case ShapeKind::LineSeg:
+        linesegs_out.push_back(std::make_pair(ind, LineSeg3D{p1, p2}));
+        break;
+    case ShapeKind::Triangle:
+        triangles_out.push_back(std::make_pair(ind, Triangle3D{p1, p2, p3}));
+        break;
+    }
+}
+
 void Driver::parse_input(ListPoint3D &points_out, ListLineSeg3D &linesegs_out,
                          ListTriangle3D &triangles_out, const std::vector<double> &inp)
 {
-    using namespace Geom;
     index_t ind = 0;
     for (auto it = inp.begin(); it != inp.end(); it+=9)
-    {
-        Point3D p1{*it, *(it+1), *(it+2)}, p2{*(it+3), *(it+4), *(it+5)}, p3{*(it+6), *(it+7), *(it+8)};
-        int eq_cnt = (p1 == p2) + (p2 == p3) + (p1 == p3);
-        if (eq_cnt == 3)
-        {
-            points_out.push_back(std::make_pair(ind++, p1));
-            continue;
-        }
+        parse_shape(ind++, &*it, points_out, linesegs_out, triangles_out);
+}
 
-        if (eq_cnt == 1)
-        {
-            if (p1 == p2)
-                linesegs_out.push_back(std::make_pair(ind++, LineSeg3D{p1, p3}));
-            else if (p1 == p3)
-                linesegs_out.push_back(std::make_pair(ind++, LineSeg3D{p1, p2}));
-            else
-                linesegs_out.push_back(std::make_pair(ind++, LineSeg3D{p2, p3}));
-            continue;
-        }
+namespace
+{
 
-        Vector3D v12 = p2 - p1;
-        Vector3D v13 = p3 - p1;
-        if (!cross_prod(v12, v13).is_zero())
-            triangles_out.push_back(std::make_pair(ind++, Triangle3D{p1, p2, p3}));
-        else
-        {
-            scalar_t dot = dot_prod(v12, v13);
-            if (leq(dot, 0))
-                linesegs_out.push_back(std::make_pair(ind++, LineSeg3D{p3, p2}));
-            else if (leq(dot, v12.len()*v12.len()))
-                linesegs_out.push_back(std::make_pair(ind++, LineSeg3D{p1, p2}));
-            else 
-                linesegs_out.push_back(std::make_pair(ind++, LineSeg3D{p1, p3}));
-        }
+// reads the number of shapes and calls on_shape(ind, coords) with the 9 coordinates of every one,
+// with the checks of get_input
+template <typename F>
+void for_each_input_shape(std::istream &stream, F &&on_shape)
+{
+    int N_inp = 0;
+    stream >> N_inp;
+    if (!stream.good() || N_inp <= 0)
+        throw std::runtime_error("Wrong input");
+
+    double coords[9];
+    for (Driver::index_t ind = 0; ind < static_cast<Driver::index_t>(N_inp); ind++)
+    {
+        for (auto &coord : coords)
+            if (!(stream >> coord))
+                throw std::runtime_error("Not full input");
+        on_shape(ind, coords);
     }
 }
 
-std::set<Driver::index_t> Driver::get_inds_with_intscs(ListPoint3D &points, 
-                                                       ListLineSeg3D &linesegs, 
-                                                       ListTriangle3D &triangles)
-{
-    using namespace Geom;
+} // anonymous namespace
 
-    std::set<index_t> indcs;
+void Driver::parse_input(ListPoint3D &points_out, ListLineSeg3D &linesegs_out,
+                         ListTriangle3D &triangles_out, std::istream &stream, Shard shard)
+{
+    using Geom::leq;
+    if (shard.count == 0 || shard.id >= shard.count)
+        throw std::runtime_error("Wrong shard");
 
-    for (auto it_out = points.begin(); it_out != points.end(); it_out++)
+    if (!shard.bounds)
     {
-        Point3D point = it_out->second;
-        bool found = false;
-        for (auto it_in = std::next(it_out); it_in != points.end(); it_in++)
-        {
-            if (it_in->second == it_out->second)
-            {
-                indcs.insert(it_in->first);
-                found = true;
-            }
-        }
+        std::streampos start = stream.tellg();
+        if (start == std::streampos(-1))
+            throw std::runtime_error("--shard needs --bounds or a seekable input");
 
-        for (auto it_lineseg = linesegs.begin(); it_lineseg != linesegs.end(); it_lineseg++)
+        std::array<double, 6> bounds = {INFINITY, INFINITY, INFINITY, -INFINITY, -INFINITY, -INFINITY};
+        for_each_input_shape(stream, [&bounds](index_t, const double *coords)
         {
-            if (it_lineseg->second.has_point(point)) 
+            for (int k = 0; k < 9; k++)
             {
-                indcs.insert(it_lineseg->first);
-                found = true;
+                bounds[k % 3] = std::min(bounds[k % 3], coords[k]);
+                bounds[3 + k % 3] = std::max(bounds[3 + k % 3], coords[k]);
             }
-        }
+        });
+        stream.clear();
+        if (!stream.seekg(start))
+            throw std::runtime_error("Can't read the input again");
+        shard.bounds = bounds;
+    }
+    const std::array<double, 6> &bounds = *shard.bounds;
 
-        for (auto it_tr = triangles.begin(); it_tr != triangles.end(); it_tr++)
-        {
-            if (it_tr->second.has_point(point)) 
-            {
-                indcs.insert(it_tr->first);
-                found = true;
-            }
-        }
-        if (found) indcs.insert(it_out->first);
+    // slabs are taken along the longest axis of the whole scene
+    int axis = 0;
+    for (int ax = 1; ax < 3; ax++)
+        if (bounds[3 + ax] - bounds[ax] > bounds[3 + axis] - bounds[axis])
+            axis = ax;
+
+    double width = (bounds[3 + axis] - bounds[axis]) / shard.count;
+    double slab_lo = (shard.id == 0) ? -INFINITY : bounds[axis] + width * shard.id;
+    double slab_hi = (shard.id + 1 == shard.count) ? INFINITY : bounds[axis] + width * (shard.id + 1);
+
+    // an error of a shape is thrown after the whole input is read, as errors of reading come first
+    std::exception_ptr shape_err;
+    for_each_input_shape(stream, [&](index_t ind, const double *coords)
+    {
+        double shape_lo = std::min({coords[axis], coords[3 + axis], coords[6 + axis]});
+        double shape_hi = std::max({coords[axis], coords[3 + axis], coords[6 + axis]});
+        // shapes that straddle the border of the slab go to every slab they touch,
+        // so every intersection is found in at least one shard
+        if (shape_err || !(leq(shape_lo, slab_hi) && leq(slab_lo, shape_hi)))
+            return;
+        try { parse_shape(ind, coords, points_out, linesegs_out, triangles_out); }
+        catch (...) { shape_err = std::current_exception(); }
+    });
+    if (shape_err)
+        std::rethrow_exception(shape_err);
+}
+
+namespace
+{
+
+// shapes closer than this are never rejected by the midphase, as the exact tests have tolerances
+const Geom::scalar_t MIDPHASE_MARGIN = 1e4 * Geom::DBL_PRECISION;
+
+} // anonymous namespace
+
+bool Driver::midphase_rejects(const Geom::Triangle3D &tr, const Geom::LineSeg3D &ls)
+{
+    Geom::BoundingBox box = ls.bound_box();
+    return tr.bound_box().intersects(box) && !tr.intersects_BoundingBox(box, MIDPHASE_MARGIN);
+}
+
+bool Driver::midphase_rejects(const Geom::Triangle3D &a, const Geom::Triangle3D &b)
+{
+    Geom::BoundingBox box_a = a.bound_box(), box_b = b.bound_box();
+    return box_a.intersects(box_b) && (!a.intersects_BoundingBox(box_b, MIDPHASE_MARGIN)
+                                       || !b.intersects_BoundingBox(box_a, MIDPHASE_MARGIN));
+}
+
+Driver::Stats &Driver::Stats::operator+=(const Stats &rhs)
+{
+    pt_pt += rhs.pt_pt; pt_ls += rhs.pt_ls; pt_tr += rhs.pt_tr;
+    ls_ls += rhs.ls_ls; ls_tr += rhs.ls_tr; tr_tr += rhs.tr_tr;
+    intscs += rhs.intscs;
+    pruned += rhs.pruned;
+    midphase += rhs.midphase;
+    return *this;
+}
+
+namespace
+{
+
+using namespace Geom;
+using Driver::index_t;
+
+// narrow-phase tests for every pair of shape kinds
+bool intersects(const Point3D &a, const Point3D &b)         {return a == b;}
+bool intersects(const Point3D &p, const LineSeg3D &ls)      {return ls.has_point(p);}
+bool intersects(const Point3D &p, const Triangle3D &tr)     {return tr.has_point(p);}
+bool intersects(const LineSeg3D &ls, const Point3D &p)      {return ls.has_point(p);}
+bool intersects(const LineSeg3D &a, const LineSeg3D &b)     {return a.intersects_LineSeg3D(b);}
+bool intersects(const LineSeg3D &ls, const Triangle3D &tr)  {return tr.intersects_LineSeg3D(ls);}
+bool intersects(const Triangle3D &tr, const Point3D &p)     {return tr.has_point(p);}
+bool intersects(const Triangle3D &tr, const LineSeg3D &ls)  {return tr.intersects_LineSeg3D(ls);}
+bool intersects(const Triangle3D &a, const Triangle3D &b)   {return a.intersects_Triangle3D(b);}
+
+// midphase for the pairs of kinds which have it
+template <typename A, typename B>
+bool midphase_rejects(const A &, const B &)                        {return false;}
+bool midphase_rejects(const LineSeg3D &ls, const Triangle3D &tr)   {return Driver::midphase_rejects(tr, ls);}
+bool midphase_rejects(const Triangle3D &tr, const LineSeg3D &ls)   {return Driver::midphase_rejects(tr, ls);}
+bool midphase_rejects(const Triangle3D &a, const Triangle3D &b)    {return Driver::midphase_rejects(a, b);}
+
+// midphase and then the exact test
+template <typename A, typename B>
+bool intersects(const A &a, const B &b, Driver::Stats &stats)
+{
+    if (midphase_rejects(a, b))
+    {
+        stats.midphase++;
+        return false;
     }
+    return intersects(a, b);
+}
+
+BoundingBox box_of(const Point3D &point)   {return BoundingBox{point};}
+BoundingBox box_of(const LineSeg3D &ls)    {return ls.bound_box();}
+BoundingBox box_of(const Triangle3D &tr)   {return tr.bound_box();}
 
-    for (auto it_out = linesegs.begin(); it_out != linesegs.end(); it_out++)
+Point3D box_center(const Point3D &point)   {return point;}
+Point3D box_center(const LineSeg3D &ls)    {return ls.bound_box().center();}
+Point3D box_center(const Triangle3D &tr)   {return tr.bound_box().center();}
+
+template <typename List>
+void add_to_bounds(const List &list, double min[3], double max[3])
+{
+    for (auto &[ind, shape] : list)
     {
-        bool found = false;
-        for (auto it_in = std::next(it_out); it_in != linesegs.end(); it_in++)
+        Point3D c = box_center(shape);
+        double coords[3] = {c.x(), c.y(), c.z()};
+        for (int axis = 0; axis < 3; axis++)
         {
-            if (it_out->second.intersects_LineSeg3D(it_in->second)) 
-            {
-                indcs.insert(it_in->first);
-                found = true;
-            }
+            min[axis] = std::min(min[axis], coords[axis]);
+            max[axis] = std::max(max[axis], coords[axis]);
         }
+    }
+}
 
-        for (auto it_tr = triangles.begin(); it_tr != triangles.end(); it_tr++)
+// rebuilds the list in the Morton order, so that the new nodes are allocated in this order too
+template <typename List>
+void sort_by_morton(List &list, const Driver::MortonGrid &grid)
+{
+    std::vector<std::pair<uint64_t, typename List::iterator>> codes;
+    codes.reserve(list.size());
+    for (auto it = list.begin(); it != list.end(); it++)
+    {
+        Point3D c = box_center(it->second);
+        codes.emplace_back(grid.code(c.x(), c.y(), c.z()), it);
+    }
+    std::stable_sort(codes.begin(), codes.end(),
+                     [](const auto &lhs, const auto &rhs) {return lhs.first < rhs.first;});
+
+    List sorted;
+    for (auto &[code, it] : codes)
+        sorted.push_back(std::move(*it));
+    list.swap(sorted);
+}
+
+size_t &narrow_counter(Driver::Stats &stats, Driver::ShapeKind a, Driver::ShapeKind b)
+{
+    using Driver::ShapeKind;
+    if (a > b)
+        std::swap(a, b);
+
+    if (a == ShapeKind::Point)
+        return (b == ShapeKind::Point) ? stats.pt_pt : (b == ShapeKind::LineSeg) ? stats.pt_ls : stats.pt_tr;
+    if (a == ShapeKind::LineSeg)
+        return (b == ShapeKind::LineSeg) ? stats.ls_ls : stats.ls_tr;
+    return stats.tr_tr;
+}
+
+template <typename T> constexpr Driver::ShapeKind kind_of = Driver::ShapeKind::Triangle;
+template <> constexpr Driver::ShapeKind kind_of<Point3D>   = Driver::ShapeKind::Point;
+template <> constexpr Driver::ShapeKind kind_of<LineSeg3D> = Driver::ShapeKind::LineSeg;
+
+// pairs of kinds whose exact test starts with the bounding box check, the engines may do it first
+// with the boxes they keep
+template <typename A, typename B>
+constexpr bool box_check_first = (std::is_same_v<A, Triangle3D> && !std::is_same_v<B, Point3D>)
+                              || (std::is_same_v<B, Triangle3D> && !std::is_same_v<A, Point3D>);
+
+// counted narrow-phase test of a pair, every combination of kinds is a separate instantiation
+template <typename A, typename B>
+bool test_pair(const A &a, const B &b, const BoundingBox &box_a, const BoundingBox &box_b, Driver::Stats &stats)
+{
+    narrow_counter(stats, kind_of<A>, kind_of<B>)++;
+    if constexpr (box_check_first<A, B>)
+        if (!box_a.intersects(box_b))
+            return false;
+
+    bool res = intersects(a, b, stats);
+    if (res) stats.intscs++;
+    return res;
+}
+
+// calls on_pair(i, j) for every intersecting pair of a[i] and b[j] with j >= min_j(i); the shape
+// of 'a' is dispatched once per row and the shape of 'b' once per pair, both through std::visit
+template <typename MinJ, typename F>
+void for_intersecting_pairs(const Driver::ShapeArray &a, const Driver::ShapeArray &b, MinJ &&min_j,
+                            Driver::Stats &stats, F &&on_pair)
+{
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        const BoundingBox &box_a = a.boxes[i];
+        std::visit([&](const auto &shape_a)
         {
-            if (it_tr->second.intersects_LineSeg3D(it_out->second))
+            for (size_t j = min_j(i); j < b.size(); j++)
             {
-                indcs.insert(it_tr->first);
-                found = true;
+                const BoundingBox &box_b = b.boxes[j];
+                bool res = std::visit([&](const auto &shape_b) {return test_pair(shape_a, shape_b, box_a, box_b, stats);},
+                                      b.shapes[j]);
+                if (res)
+                    on_pair(i, j);
             }
-        }
-        if (found) indcs.insert(it_out->first);
+        }, a.shapes[i]);
     }
+}
+
+} // anonymous namespace
 
-    for (auto it_out = triangles.begin(); it_out != triangles.end(); it_out++)
-    {   
-        bool found = false;
-        for (auto it_in = std::next(it_out); it_in != triangles.end(); it_in++)
+void Driver::reorder_morton(ListPoint3D &points, ListLineSeg3D &linesegs, ListTriangle3D &triangles)
+{
+    double min[3] = { INFINITY,  INFINITY,  INFINITY};
+    double max[3] = {-INFINITY, -INFINITY, -INFINITY};
+    add_to_bounds(points, min, max);
+    add_to_bounds(linesegs, min, max);
+    add_to_bounds(triangles, min, max);
+
+    MortonGrid grid{min, max};
+    sort_by_morton(points, grid);
+    sort_by_morton(linesegs, grid);
+    sort_by_morton(triangles, grid);
+}
+
+Geom::BoundingBox Driver::bound_box(const Shape &shape)
+{
+    return std::visit([](const auto &s) {return box_of(s);}, shape);
+}
+
+Driver::ShapeArray Driver::make_shape_array(const ListPoint3D &points, const ListLineSeg3D &linesegs,
+                                            const ListTriangle3D &triangles)
+{
+    std::vector<index_t> inds;
+    std::vector<Shape> shapes;
+    std::vector<BoundingBox> boxes;
+    size_t n = points.size() + linesegs.size() + triangles.size();
+    inds.reserve(n);
+    shapes.reserve(n);
+    boxes.reserve(n);
+
+    auto add = [&](const auto &list)
+    {
+        for (auto &[ind, shape] : list)
         {
-            if (it_in->second.intersects_Triangle3D(it_out->second))
-            {
-                indcs.insert(it_in->first);
-                found = true;
-            }
+            inds.push_back(ind);
+            shapes.emplace_back(shape);
+            boxes.push_back(box_of(shape));
         }
-        if (found) indcs.insert(it_out->first);
-    }
+    };
+    add(points);
+    add(linesegs);
+    add(triangles);
+    return ShapeArray{Storage<index_t>{std::move(inds)}, Storage<Shape>{std::move(shapes)},
+                      Storage<BoundingBox>{std::move(boxes)}};
+}
+
+Driver::ShapeArray Driver::make_shape_array(std::vector<index_t> &&inds, std::vector<Shape> &&shapes)
+{
+    std::vector<BoundingBox> boxes;
+    boxes.reserve(shapes.size());
+    for (auto &shape : shapes)
+        boxes.push_back(bound_box(shape));
+    return ShapeArray{Storage<index_t>{std::move(inds)}, Storage<Shape>{std::move(shapes)},
+                      Storage<BoundingBox>{std::move(boxes)}};
+}
+
+bool Driver::intersects(const Shape &a, const Shape &b, Stats &stats)
+{
+    return std::visit([&stats](const auto &shape_a, const auto &shape_b)
+    {
+        return test_pair(shape_a, shape_b, box_of(shape_a), box_of(shape_b), stats);
+    }, a, b);
+}
+
+std::set<Driver::index_t> Driver::get_inds_with_intscs(ListPoint3D &points, ListLineSeg3D &linesegs,
+                                                       ListTriangle3D &triangles, Stats *stats,
+                                                       UnionFind *components)
+{
+    return get_inds_with_intscs(make_shape_array(points, linesegs, triangles), stats, components);
+}
+
+std::set<Driver::index_t> Driver::get_inds_with_intscs(const ShapeArray &arr, Stats *stats, UnionFind *components)
+{
+    std::set<index_t> indcs;
+    Stats st;
+    for_intersecting_pairs(arr, arr, [](size_t i) {return i + 1;}, st, [&](size_t i, size_t j)
+    {
+        indcs.insert(arr.inds[i]);
+        indcs.insert(arr.inds[j]);
+        if (components)
+            components->unite(arr.inds[i], arr.inds[j]);
+    });
 
+    if (stats) *stats = st;
     return indcs;
-}
\ No newline at end of file
+}
+
+void Driver::get_inds_with_cross_intscs(const Shapes &a, const Shapes &b, std::set<index_t> &inds_a,
+                                        std::set<index_t> &inds_b, Stats *stats, UnionFind *components)
+{
+    get_inds_with_cross_intscs(make_shape_array(a.points, a.linesegs, a.triangles),
+                               make_shape_array(b.points, b.linesegs, b.triangles), inds_a, inds_b, stats, components);
+}
+
+void Driver::get_inds_with_cross_intscs(const ShapeArray &arr_a, const ShapeArray &arr_b, std::set<index_t> &inds_a,
+                                        std::set<index_t> &inds_b, Stats *stats, UnionFind *components)
+{
+    Stats st;
+    for_intersecting_pairs(arr_a, arr_b, [](size_t) {return size_t{0};}, st, [&](size_t i, size_t j)
+    {
+        inds_a.insert(arr_a.inds[i]);
+        inds_b.insert(arr_b.inds[j]);
+        if (components)
+            components->unite(arr_a.inds[i], arr_b.inds[j]);
+    });
+
+    if (stats) *stats = st;
+}
+
+namespace
+{
+
+// the engine is picked by the number of pairs of shapes: up to BRUTE_PAIRS setting anything up
+// doesn't pay off, up to TILED_PAIRS the tiled loop is faster than building a hierarchy, and above
+// it the tiled loop is still used if at least DENSE_SHARE of pairs of sampled boxes intersect
+const size_t BRUTE_PAIRS = 256;
+const size_t TILED_PAIRS = 1 << 19;
+const double DENSE_SHARE = 0.05;
+const size_t SAMPLE_SIZE = 256;
+
+// boxes of at most SAMPLE_SIZE shapes taken evenly from the array
+std::vector<BoundingBox> sample_boxes(const Driver::ShapeArray &arr)
+{
+    size_t step = std::max<size_t>(1, arr.size() / SAMPLE_SIZE);
+    std::vector<BoundingBox> boxes;
+    for (size_t i = 0; i < arr.size() && boxes.size() < SAMPLE_SIZE; i += step)
+        boxes.push_back(arr.boxes[i]);
+    return boxes;
+}
+
+// share of intersecting pairs of boxes, of different boxes when a and b are the same sample
+double overlap_share(const std::vector<BoundingBox> &a, const std::vector<BoundingBox> &b, bool self)
+{
+    size_t n_pairs = 0, n_overlaps = 0;
+    for (size_t i = 0; i < a.size(); i++)
+        for (size_t j = self ? i + 1 : 0; j < b.size(); j++)
+        {
+            n_pairs++;
+            n_overlaps += a[i].intersects(b[j]);
+        }
+    return n_pairs ? static_cast<double>(n_overlaps) / n_pairs : 0;
+}
+
+// overlap_share() is called only when the number of pairs isn't enough to decide
+template <typename Share>
+Driver::Engine pick_engine(size_t n_pairs, Share &&overlap_share)
+{
+    using Driver::Engine;
+    if (n_pairs <= BRUTE_PAIRS)
+        return Engine::BruteForce;
+    if (n_pairs <= TILED_PAIRS || overlap_share() >= DENSE_SHARE)
+        return Engine::Tiled;
+    return Engine::BVH8;
+}
+
+} // anonymous namespace
+
+Driver::Engine Driver::choose_engine(const ShapeArray &arr)
+{
+    size_t n = arr.size();
+    return pick_engine(n * (n - std::min<size_t>(n, 1)) / 2, [&]()
+    {
+        std::vector<BoundingBox> sample = sample_boxes(arr);
+        return overlap_share(sample, sample, true);
+    });
+}
+
+Driver::Engine Driver::choose_engine(const ShapeArray &a, const ShapeArray &b)
+{
+    return pick_engine(a.size() * b.size(), [&]()
+    {
+        return overlap_share(sample_boxes(a), sample_boxes(b), false);
+    });
+}
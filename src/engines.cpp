@@ -0,0 +1,60 @@
+#include "driver.hpp"
+#include "lbvh.hpp"
+#include "bvh8.hpp"
+#include "tiled.hpp"
+
+#include <stdexcept>
+
+// dispatch to the engines, apart from driver.cpp so that the code using only some of the engines
+// (the flat API) doesn't link all of them
+
+std::set<Driver::index_t> Driver::get_inds_with_intscs(ListPoint3D &points, ListLineSeg3D &linesegs,
+                                                       ListTriangle3D &triangles, Engine engine, Stats *stats,
+                                                       UnionFind *components)
+{
+    return get_inds_with_intscs(make_shape_array(points, linesegs, triangles), engine, stats, components);
+}
+
+std::set<Driver::index_t> Driver::get_inds_with_intscs(const ShapeArray &arr, Engine engine, Stats *stats,
+                                                       UnionFind *components)
+{
+    switch (engine)
+    {
+    case Engine::BruteForce: return get_inds_with_intscs(arr, stats, components);
+    case Engine::Tiled:      return get_inds_with_intscs_tiled(arr, stats, components);
+    case Engine::LBVH:       return get_inds_with_intscs_lbvh(arr, stats, components);
+    case Engine::LBVH18:     return get_inds_with_intscs_lbvh<Geom::DOP18>(arr, stats, components);
+    case Engine::BVH8:       return get_inds_with_intscs_bvh8(arr, stats, components);
+    case Engine::Auto:       return get_inds_with_intscs(arr, choose_engine(arr), stats, components);
+    }
+    throw std::runtime_error("Unknown engine");
+}
+
+void Driver::get_inds_with_cross_intscs(const Shapes &a, const Shapes &b, std::set<index_t> &inds_a,
+                                        std::set<index_t> &inds_b, Engine engine, Stats *stats,
+                                        UnionFind *components)
+{
+    get_inds_with_cross_intscs(make_shape_array(a.points, a.linesegs, a.triangles),
+                               make_shape_array(b.points, b.linesegs, b.triangles), inds_a, inds_b, engine,
+                               stats, components);
+}
+
+void Driver::get_inds_with_cross_intscs(const ShapeArray &a, const ShapeArray &b, std::set<index_t> &inds_a,
+                                        std::set<index_t> &inds_b, Engine engine, Stats *stats,
+                                        UnionFind *components)
+{
+    switch (engine)
+    {
+    case Engine::BruteForce: get_inds_with_cross_intscs(a, b, inds_a, inds_b, stats, components); return;
+    case Engine::Tiled:      get_inds_with_cross_intscs_tiled(a, b, inds_a, inds_b, stats, components); return;
+    case Engine::LBVH:       get_inds_with_cross_intscs_lbvh(a, b, inds_a, inds_b, stats, components); return;
+    case Engine::LBVH18:
+        get_inds_with_cross_intscs_lbvh<Geom::DOP18>(a, b, inds_a, inds_b, stats, components);
+        return;
+    case Engine::BVH8:       get_inds_with_cross_intscs_bvh8(a, b, inds_a, inds_b, stats, components); return;
+    case Engine::Auto:
+        get_inds_with_cross_intscs(a, b, inds_a, inds_b, choose_engine(a, b), stats, components);
+        return;
+    }
+    throw std::runtime_error("Unknown engine");
+}
@@ -0,0 +1,442 @@
+#include "exact.hpp"
+#include "lbvh.hpp"
+#include "parallel.hpp"
+#include "union_find.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace Driver
+{
+
+namespace Exact
+{
+
+namespace
+{
+
+// coordinates over this many steps from zero don't fit llround
+const double MAX_STEPS = 0x1p62;
+// finer steps would be subnormal
+const int MIN_STEP_EXP = -1000;
+
+bool fits(double min, double max, double step, int64_t &origin)
+{
+    if (!(std::abs(min / step) < MAX_STEPS && std::abs(max / step) < MAX_STEPS))
+        return false;
+    origin = std::llround((min / 2 + max / 2) / step);
+    return std::llround(min / step) - origin >= -MAX_COORD && std::llround(max / step) - origin <= MAX_COORD;
+}
+
+bool fits(const double min[3], const double max[3], Grid &grid)
+{
+    for (int axis = 0; axis < 3; axis++)
+        if (!fits(min[axis], max[axis], grid.step, grid.origin[axis]))
+            return false;
+    return true;
+}
+
+} // anonymous namespace
+
+Grid choose_grid(const std::vector<double> &inp, const Params &params)
+{
+    double min[3] = {INFINITY, INFINITY, INFINITY}, max[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (size_t i = 0; i < inp.size(); i++)
+    {
+        if (!std::isfinite(inp[i]))
+            throw WrongGrid("Wrong input: coordinates must be finite in the exact mode");
+        min[i % 3] = std::min(min[i % 3], inp[i]);
+        max[i % 3] = std::max(max[i % 3], inp[i]);
+    }
+    if (inp.empty())
+        return Grid{};
+
+    Grid grid;
+    if (params.step > 0)
+    {
+        grid.step = params.step;
+        if (!fits(min, max, grid))
+            throw WrongGrid("Scene doesn't fit the grid: more than 2^30 steps from its center");
+        return grid;
+    }
+
+    double half = 0;
+    for (int axis = 0; axis < 3; axis++)
+        half = std::max(half, max[axis] / 2 - min[axis] / 2);
+
+    // the first guess is usually right, it can miss by a step of rounding of the center
+    int exp = (half > 0) ? std::max(std::ilogb(half / MAX_COORD), MIN_STEP_EXP) : 0;
+    grid.step = std::ldexp(1.0, exp);
+    while (!fits(min, max, grid))
+        grid.step *= 2;
+    return grid;
+}
+
+namespace
+{
+
+using wide_t = __int128;
+
+// difference of two points on the grid, components are below 2^31 in magnitude
+struct Vec
+{
+    int64_t x, y, z;
+};
+
+// cross product of two differences, components are below 2^63 in magnitude
+struct Wide
+{
+    wide_t x, y, z;
+};
+
+Vec diff(const IPoint &a, const IPoint &b)
+{
+    return {int64_t{a[0]} - b[0], int64_t{a[1]} - b[1], int64_t{a[2]} - b[2]};
+}
+
+Wide cross(const Vec &a, const Vec &b)
+{
+    return {wide_t{a.y} * b.z - wide_t{a.z} * b.y,
+            wide_t{a.z} * b.x - wide_t{a.x} * b.z,
+            wide_t{a.x} * b.y - wide_t{a.y} * b.x};
+}
+
+// below 2^96 in magnitude
+wide_t dot(const Wide &a, const Vec &b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+int sign(wide_t val)
+{
+    return (val > 0) - (val < 0);
+}
+
+bool is_zero(const Wide &v)
+{
+    return v.x == 0 && v.y == 0 && v.z == 0;
+}
+
+wide_t abs(wide_t val)
+{
+    return (val < 0) ? -val : val;
+}
+
+Wide normal(const IPoint &a, const IPoint &b, const IPoint &c)
+{
+    return cross(diff(b, a), diff(c, a));
+}
+
+// side of the plane abc where d lies: sign of the volume of the tetrahedron abcd
+int orient3d(const IPoint &a, const IPoint &b, const IPoint &c, const IPoint &d)
+{
+    return sign(dot(normal(a, b, c), diff(d, a)));
+}
+
+// the axis to project a plane with the normal along: the largest component of the normal,
+// then the projection is a bijection of the plane
+int projection_axis(const Wide &n)
+{
+    wide_t x = abs(n.x), y = abs(n.y), z = abs(n.z);
+    return (x >= y && x >= z) ? 0 : (y >= z) ? 1 : 2;
+}
+
+// point projected along the axis
+struct Point2
+{
+    int64_t u, v;
+};
+
+Point2 project(const IPoint &p, int axis)
+{
+    return {p[(axis + 1) % 3], p[(axis + 2) % 3]};
+}
+
+int orient2d(const Point2 &a, const Point2 &b, const Point2 &c)
+{
+    return sign(wide_t{b.u - a.u} * (c.v - a.v) - wide_t{b.v - a.v} * (c.u - a.u));
+}
+
+// c lies on the line ab, is it on the segment
+bool on_segment(const Point2 &a, const Point2 &b, const Point2 &c)
+{
+    return std::min(a.u, b.u) <= c.u && c.u <= std::max(a.u, b.u)
+        && std::min(a.v, b.v) <= c.v && c.v <= std::max(a.v, b.v);
+}
+
+bool on_segment(const IPoint &a, const IPoint &b, const IPoint &c)
+{
+    for (int axis = 0; axis < 3; axis++)
+        if (c[axis] < std::min(a[axis], b[axis]) || c[axis] > std::max(a[axis], b[axis]))
+            return false;
+    return true;
+}
+
+bool segments_intersect(const Point2 &p, const Point2 &q, const Point2 &r, const Point2 &s)
+{
+    int o1 = orient2d(p, q, r), o2 = orient2d(p, q, s), o3 = orient2d(r, s, p), o4 = orient2d(r, s, q);
+    if (o1 * o2 < 0 && o3 * o4 < 0)
+        return true;
+    return (o1 == 0 && on_segment(p, q, r)) || (o2 == 0 && on_segment(p, q, s))
+        || (o3 == 0 && on_segment(r, s, p)) || (o4 == 0 && on_segment(r, s, q));
+}
+
+// boundary included
+bool in_triangle(const Point2 tr[3], const Point2 &p)
+{
+    int o1 = orient2d(tr[0], tr[1], p), o2 = orient2d(tr[1], tr[2], p), o3 = orient2d(tr[2], tr[0], p);
+    bool neg = o1 < 0 || o2 < 0 || o3 < 0, pos = o1 > 0 || o2 > 0 || o3 > 0;
+    return !(neg && pos);
+}
+
+void project(const IPoint tr[3], int axis, Point2 out[3])
+{
+    for (int i = 0; i < 3; i++)
+        out[i] = project(tr[i], axis);
+}
+
+bool point_lineseg(const IPoint &p, const IPoint &a, const IPoint &b)
+{
+    return is_zero(cross(diff(b, a), diff(p, a))) && on_segment(a, b, p);
+}
+
+bool point_triangle(const IPoint &p, const IPoint tr[3])
+{
+    Wide n = normal(tr[0], tr[1], tr[2]);
+    if (dot(n, diff(p, tr[0])) != 0)
+        return false;
+
+    int axis = projection_axis(n);
+    Point2 tr2[3];
+    project(tr, axis, tr2);
+    return in_triangle(tr2, project(p, axis));
+}
+
+bool lineseg_lineseg(const IPoint &p, const IPoint &q, const IPoint &r, const IPoint &s)
+{
+    if (orient3d(p, q, r, s) != 0)
+        return false;
+
+    Vec dir = diff(q, p);
+    Wide n = cross(dir, diff(r, p));
+    if (is_zero(n))
+        n = cross(dir, diff(s, p));
+
+    int axis = 0;
+    if (!is_zero(n))
+        axis = projection_axis(n);
+    else
+    {
+        // all four points are on one line: the smallest component of its direction is dropped
+        int64_t x = std::abs(dir.x), y = std::abs(dir.y), z = std::abs(dir.z);
+        axis = (x <= y && x <= z) ? 0 : (y <= z) ? 1 : 2;
+    }
+    return segments_intersect(project(p, axis), project(q, axis), project(r, axis), project(s, axis));
+}
+
+bool lineseg_triangle(const IPoint &p, const IPoint &q, const IPoint tr[3])
+{
+    int op = orient3d(tr[0], tr[1], tr[2], p), oq = orient3d(tr[0], tr[1], tr[2], q);
+    if (op * oq > 0)
+        return false;
+
+    if (op == 0 && oq == 0)
+    {
+        int axis = projection_axis(normal(tr[0], tr[1], tr[2]));
+        Point2 tr2[3], p2 = project(p, axis), q2 = project(q, axis);
+        project(tr, axis, tr2);
+        if (in_triangle(tr2, p2))
+            return true;
+        for (int i = 0; i < 3; i++)
+            if (segments_intersect(p2, q2, tr2[i], tr2[(i + 1) % 3]))
+                return true;
+        return false;
+    }
+
+    // the segment crosses the plane, the line through it must pass by every edge on one side
+    int s1 = orient3d(p, q, tr[0], tr[1]), s2 = orient3d(p, q, tr[1], tr[2]), s3 = orient3d(p, q, tr[2], tr[0]);
+    bool neg = s1 < 0 || s2 < 0 || s3 < 0, pos = s1 > 0 || s2 > 0 || s3 > 0;
+    return !(neg && pos);
+}
+
+bool triangle_triangle(const IPoint a[3], const IPoint b[3])
+{
+    int oa[3], ob[3];
+    for (int i = 0; i < 3; i++)
+    {
+        oa[i] = orient3d(b[0], b[1], b[2], a[i]);
+        ob[i] = orient3d(a[0], a[1], a[2], b[i]);
+    }
+    auto one_side = [](const int o[3]) {return (o[0] > 0 && o[1] > 0 && o[2] > 0) || (o[0] < 0 && o[1] < 0 && o[2] < 0);};
+    if (one_side(oa) || one_side(ob))
+        return false;
+
+    if (oa[0] == 0 && oa[1] == 0 && oa[2] == 0)
+    {
+        int axis = projection_axis(normal(b[0], b[1], b[2]));
+        Point2 a2[3], b2[3];
+        project(a, axis, a2);
+        project(b, axis, b2);
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                if (segments_intersect(a2[i], a2[(i + 1) % 3], b2[j], b2[(j + 1) % 3]))
+                    return true;
+        return in_triangle(b2, a2[0]) || in_triangle(a2, b2[0]);
+    }
+
+    // not coplanar: both ends of the common segment of the triangles are on their edges
+    for (int i = 0; i < 3; i++)
+        if (lineseg_triangle(a[i], a[(i + 1) % 3], b) || lineseg_triangle(b[i], b[(i + 1) % 3], a))
+            return true;
+    return false;
+}
+
+// a's kind isn't after b's one
+bool test_ordered(const IShape &a, const IShape &b)
+{
+    switch (a.kind)
+    {
+    case ShapeKind::Point:
+        switch (b.kind)
+        {
+        case ShapeKind::Point:   return a.v[0] == b.v[0];
+        case ShapeKind::LineSeg: return point_lineseg(a.v[0], b.v[0], b.v[1]);
+        default:                 return point_triangle(a.v[0], b.v);
+        }
+    case ShapeKind::LineSeg:
+        if (b.kind == ShapeKind::LineSeg)
+            return lineseg_lineseg(a.v[0], a.v[1], b.v[0], b.v[1]);
+        return lineseg_triangle(a.v[0], a.v[1], b.v);
+    default:
+        return triangle_triangle(a.v, b.v);
+    }
+}
+
+size_t &narrow_counter(Stats &stats, ShapeKind a, ShapeKind b)
+{
+    if (a == ShapeKind::Point)
+        return (b == ShapeKind::Point) ? stats.pt_pt : (b == ShapeKind::LineSeg) ? stats.pt_ls : stats.pt_tr;
+    if (a == ShapeKind::LineSeg)
+        return (b == ShapeKind::LineSeg) ? stats.ls_ls : stats.ls_tr;
+    return stats.tr_tr;
+}
+
+Geom::Point3D to_point(const IPoint &p)
+{
+    return Geom::Point3D{double(p[0]), double(p[1]), double(p[2])};
+}
+
+// integers are exact in double, and the tolerance of the box test is far below a step
+Geom::BoundingBox box_of(const IShape &shape)
+{
+    switch (shape.kind)
+    {
+    case ShapeKind::Point:   return Geom::BoundingBox{to_point(shape.v[0])};
+    case ShapeKind::LineSeg: return Geom::BoundingBox{to_point(shape.v[0]), to_point(shape.v[1])};
+    default:                 return Geom::BoundingBox{to_point(shape.v[0]), to_point(shape.v[1]), to_point(shape.v[2])};
+    }
+}
+
+} // anonymous namespace
+
+IShape quantize(const double *coords, const Grid &grid)
+{
+    IShape shape;
+    for (int i = 0; i < 3; i++)
+        for (int axis = 0; axis < 3; axis++)
+            shape.v[i][axis] = static_cast<int32_t>(std::llround(coords[3 * i + axis] / grid.step) - grid.origin[axis]);
+
+    const IPoint *v = shape.v;
+    if (v[0] == v[1] && v[1] == v[2])
+    {
+        shape.kind = ShapeKind::Point;
+        return shape;
+    }
+    if (!is_zero(normal(v[0], v[1], v[2])))
+    {
+        shape.kind = ShapeKind::Triangle;
+        return shape;
+    }
+
+    // collinear: the segment is between the farthest two vertices
+    auto len2 = [](const Vec &d) {return wide_t{d.x} * d.x + wide_t{d.y} * d.y + wide_t{d.z} * d.z;};
+    wide_t l01 = len2(diff(v[1], v[0])), l02 = len2(diff(v[2], v[0])), l12 = len2(diff(v[2], v[1]));
+    if (l02 > l01 && l02 >= l12)
+        shape.v[1] = shape.v[2];
+    else if (l12 > l01)
+        shape.v[0] = shape.v[2];
+    shape.kind = ShapeKind::LineSeg;
+    return shape;
+}
+
+bool intersects(const IShape &a, const IShape &b, Stats &stats)
+{
+    bool ordered = a.kind <= b.kind;
+    const IShape &first = ordered ? a : b, &second = ordered ? b : a;
+    narrow_counter(stats, first.kind, second.kind)++;
+    bool res = test_ordered(first, second);
+    if (res) stats.intscs++;
+    return res;
+}
+
+std::set<index_t> get_inds_with_intscs(const std::vector<double> &inp, const Params &params, Stats *stats,
+                                       UnionFind *components)
+{
+    if (stats)
+        *stats = Stats{};
+    size_t n = inp.size() / 9;
+    if (n == 0)
+        return {};
+
+    Grid grid = choose_grid(inp, params);
+    std::vector<IShape> shapes(n);
+    std::vector<Geom::BoundingBox> boxes(n, Geom::BoundingBox{Geom::Point3D{0, 0, 0}});
+    Parallel::for_blocks(n, [&](size_t, size_t begin, size_t end)
+    {
+        for (size_t ind = begin; ind < end; ind++)
+        {
+            shapes[ind] = quantize(&inp[9 * ind], grid);
+            boxes[ind] = box_of(shapes[ind]);
+        }
+    });
+
+    LBVH bvh{boxes};
+    std::vector<std::atomic<bool>> found(n);
+    std::vector<Stats> thread_stats(Parallel::n_threads());
+
+    // every pair is tested once: leaf is tested only against leaves after it
+    const size_t GRAIN = 64;
+    Parallel::for_each(n, GRAIN, [&](size_t thr, size_t leaf)
+    {
+        index_t ind = bvh.leaf_item(leaf);
+        bvh.query(bvh.leaf_box(leaf), [&](size_t other_leaf)
+        {
+            if (other_leaf == leaf)
+                return;
+            index_t other = bvh.leaf_item(other_leaf);
+            if (intersects(shapes[ind], shapes[other], thread_stats[thr]))
+            {
+                found[ind].store(true, std::memory_order_relaxed);
+                found[other].store(true, std::memory_order_relaxed);
+                if (components)
+                    components->unite(ind, other);
+            }
+        }, leaf);
+    });
+
+    std::set<index_t> indcs;
+    for (index_t ind = 0; ind < n; ind++)
+        if (found[ind].load(std::memory_order_relaxed))
+            indcs.insert(indcs.end(), ind);
+
+    if (stats)
+        for (auto &st : thread_stats)
+            *stats += st;
+    return indcs;
+}
+
+} // namespace Exact
+
+} // namespace Driver
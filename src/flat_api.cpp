@@ -0,0 +1,117 @@
+#include "flat_api.hpp"
+#include "lbvh.hpp"
+#include "parallel.hpp"
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <utility>
+
+namespace Driver
+{
+
+namespace Flat
+{
+
+namespace
+{
+
+template <typename T>
+Geom::Point3D point(const ShapeBuffer<T> &shapes, size_t shape, int k)
+{
+    const T *it = shapes.data + shape * shapes.stride + 3 * k;
+    return Geom::Point3D{static_cast<double>(it[0]), static_cast<double>(it[1]), static_cast<double>(it[2])};
+}
+
+template <typename T>
+Shape shape_of(const ShapeBuffer<T> &shapes, size_t shape)
+{
+    return with_shape(point(shapes, shape, 0), point(shapes, shape, 1), point(shapes, shape, 2),
+                      [](const auto &s) {return Shape{s};});
+}
+
+// calls on_intsc(thread_id, i, j) once for every intersecting pair of shapes
+template <typename T, typename F>
+void for_each_intsc(const ShapeBuffer<T> &shapes, Stats *stats, F &&on_intsc)
+{
+    if (shapes.count && !shapes.data)
+        throw WrongBuffer("no data");
+    if (shapes.stride < 9)
+        throw WrongBuffer("stride is less than 9");
+
+    // a shape and its box have the same extent whatever its kind is
+    std::vector<Geom::BoundingBox> boxes(shapes.count, Geom::BoundingBox{Geom::Point3D{0, 0, 0}});
+    for (size_t i = 0; i < shapes.count; i++)
+        boxes[i] = Geom::BoundingBox{point(shapes, i, 0), point(shapes, i, 1), point(shapes, i, 2)};
+
+    LBVH bvh{boxes};
+    std::vector<Stats> thread_stats(Parallel::n_threads());
+
+    bvh.query_self_pairs([&](size_t thr, size_t leaf, size_t other_leaf)
+    {
+        size_t shape = bvh.leaf_item(leaf), other = bvh.leaf_item(other_leaf);
+        if (intersects(shape_of(shapes, shape), shape_of(shapes, other), thread_stats[thr]))
+            on_intsc(thr, shape, other);
+    });
+
+    if (stats)
+    {
+        *stats = Stats{};
+        for (auto &st : thread_stats)
+            *stats += st;
+    }
+}
+
+} // anonymous namespace
+
+template <typename T>
+size_t get_inds_with_intscs(const ShapeBuffer<T> &shapes, index_t *out, size_t capacity, Stats *stats)
+{
+    std::vector<std::atomic<bool>> found(shapes.count);
+    for_each_intsc(shapes, stats, [&](size_t, size_t a, size_t b)
+    {
+        found[a].store(true, std::memory_order_relaxed);
+        found[b].store(true, std::memory_order_relaxed);
+    });
+
+    size_t total = 0;
+    for (size_t i = 0; i < shapes.count; i++)
+        if (found[i].load(std::memory_order_relaxed))
+        {
+            if (total < capacity)
+                out[total] = i;
+            total++;
+        }
+    return total;
+}
+
+template <typename T>
+size_t get_pairs_with_intscs(const ShapeBuffer<T> &shapes, index_t *out, size_t capacity, Stats *stats)
+{
+    std::vector<std::vector<std::pair<index_t, index_t>>> thread_pairs(Parallel::n_threads());
+    for_each_intsc(shapes, stats, [&](size_t thr, size_t a, size_t b)
+    {
+        thread_pairs[thr].emplace_back(std::min(a, b), std::max(a, b));
+    });
+
+    std::vector<std::pair<index_t, index_t>> pairs;
+    for (auto &thr_pairs : thread_pairs)
+        pairs.insert(pairs.end(), thr_pairs.begin(), thr_pairs.end());
+    std::sort(pairs.begin(), pairs.end());
+
+    for (size_t k = 0; k < std::min(capacity, pairs.size()); k++)
+    {
+        out[2 * k]     = pairs[k].first;
+        out[2 * k + 1] = pairs[k].second;
+    }
+    return pairs.size();
+}
+
+template size_t get_inds_with_intscs(const ShapeBuffer<double> &, index_t *, size_t, Stats *);
+template size_t get_inds_with_intscs(const ShapeBuffer<float> &, index_t *, size_t, Stats *);
+template size_t get_pairs_with_intscs(const ShapeBuffer<double> &, index_t *, size_t, Stats *);
+template size_t get_pairs_with_intscs(const ShapeBuffer<float> &, index_t *, size_t, Stats *);
+
+} // namespace Flat
+
+} // namespace Driver
@@ -0,0 +1,366 @@
+#include "lbvh.hpp"
+#include "union_find.hpp"
+#include "morton.hpp"
+#include "parallel.hpp"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+namespace Driver
+{
+
+void parallel_radix_sort(std::vector<uint64_t> &keys, std::vector<uint32_t> &values)
+{
+    const int DIGIT_BITS = 8;
+    const size_t N_BUCKETS = 1 << DIGIT_BITS;
+    using Histogram = std::array<size_t, N_BUCKETS>;
+
+    size_t n = keys.size();
+    size_t n_thr = Parallel::n_threads();
+    std::vector<uint64_t> tmp_keys(n);
+    std::vector<uint32_t> tmp_values(n);
+    std::vector<Histogram> hists(n_thr);
+
+    for (int shift = 0; shift < 64; shift += DIGIT_BITS)
+    {
+        auto digit = [shift](uint64_t key) {return (key >> shift) & (N_BUCKETS - 1);};
+
+        Parallel::for_blocks(n, [&](size_t thr, size_t begin, size_t end)
+        {
+            hists[thr].fill(0);
+            for (size_t i = begin; i < end; i++)
+                hists[thr][digit(keys[i])]++;
+        });
+
+        // offsets of every (bucket, thread) in the output, threads keep the order of their blocks
+        size_t offset = 0;
+        bool single_bucket = false;
+        for (size_t bucket = 0; bucket < N_BUCKETS; bucket++)
+        {
+            size_t bucket_size = 0;
+            for (size_t thr = 0; thr < n_thr; thr++)
+            {
+                size_t cnt = hists[thr][bucket];
+                hists[thr][bucket] = offset;
+                offset += cnt;
+                bucket_size += cnt;
+            }
+            single_bucket = single_bucket || bucket_size == n;
+        }
+        if (single_bucket) // the pass wouldn't change anything
+            continue;
+
+        Parallel::for_blocks(n, [&](size_t thr, size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                size_t pos = hists[thr][digit(keys[i])]++;
+                tmp_keys[pos] = keys[i];
+                tmp_values[pos] = values[i];
+            }
+        });
+        keys.swap(tmp_keys);
+        values.swap(tmp_values);
+    }
+}
+
+namespace
+{
+
+// length of the common prefix of the keys of leaves i and j, equal keys are
+// distinguished by the leaf indices; -1 if j is out of range
+int delta(const std::vector<uint64_t> &codes, int64_t i, int64_t j)
+{
+    if (j < 0 || j >= static_cast<int64_t>(codes.size()))
+        return -1;
+    if (codes[i] == codes[j])
+        return 64 + __builtin_clz(static_cast<uint32_t>(i ^ j));
+    return __builtin_clzll(codes[i] ^ codes[j]);
+}
+
+// bounds of the box centers for the Morton grid
+template <typename Volume>
+std::array<double, 6> center_bounds(const std::vector<Volume> &boxes)
+{
+    size_t n_thr = Parallel::n_threads();
+    std::vector<std::array<double, 6>> thread_bounds(n_thr, {INFINITY, INFINITY, INFINITY,
+                                                             -INFINITY, -INFINITY, -INFINITY});
+    Parallel::for_blocks(boxes.size(), [&](size_t thr, size_t begin, size_t end)
+    {
+        auto &b = thread_bounds[thr];
+        for (size_t i = begin; i < end; i++)
+        {
+            Geom::Point3D c = boxes[i].center();
+            double coords[3] = {c.x(), c.y(), c.z()};
+            for (int axis = 0; axis < 3; axis++)
+            {
+                b[axis]     = std::min(b[axis], coords[axis]);
+                b[axis + 3] = std::max(b[axis + 3], coords[axis]);
+            }
+        }
+    });
+
+    std::array<double, 6> bounds = thread_bounds[0];
+    for (auto &b : thread_bounds)
+        for (int axis = 0; axis < 3; axis++)
+        {
+            bounds[axis]     = std::min(bounds[axis], b[axis]);
+            bounds[axis + 3] = std::max(bounds[axis + 3], b[axis + 3]);
+        }
+    return bounds;
+}
+
+} // anonymous namespace
+
+template <typename Volume>
+BasicLBVH<Volume>::BasicLBVH(const std::vector<Volume> &boxes) : BasicLBVH(boxes, center_bounds(boxes)) {}
+
+template <typename Volume>
+BasicLBVH<Volume>::BasicLBVH(const std::vector<Volume> &boxes, const std::array<double, 6> &bounds)
+{
+    size_t n = boxes.size();
+    if (n == 0)
+        return;
+    // leaves are numbered below LEAF_FLAG, as in a mapped scene file
+    if (n >= LEAF_FLAG)
+        throw std::runtime_error("Too many shapes for an LBVH");
+
+    double min[3] = {bounds[0], bounds[1], bounds[2]}, max[3] = {bounds[3], bounds[4], bounds[5]};
+    MortonGrid grid{min, max};
+    std::vector<uint64_t> codes(n);
+    std::vector<uint32_t> items(n);
+    std::iota(items.begin(), items.end(), 0);
+    Parallel::for_blocks(n, [&](size_t, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            Geom::Point3D c = boxes[i].center();
+            codes[i] = grid.code(c.x(), c.y(), c.z());
+        }
+    });
+
+    parallel_radix_sort(codes, items);
+
+    std::vector<Volume> sorted_boxes(n, Volume{Geom::Point3D{0, 0, 0}});
+    Parallel::for_blocks(n, [&](size_t, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+            sorted_boxes[i] = boxes[items[i]];
+    });
+    leaf_items_ = Storage<uint32_t>{std::move(items)};
+    leaf_boxes_ = Storage<Volume>{std::move(sorted_boxes)};
+
+    if (n == 1)
+        return;
+
+    std::vector<Node> nodes(n - 1);
+    std::vector<node_t> parents(2 * n - 1); // internal nodes first, then leaves
+    emit_hierarchy(codes, parents, nodes);
+    compute_boxes(parents, nodes);
+    nodes_ = Storage<Node>{std::move(nodes)};
+}
+
+template <typename Volume>
+void BasicLBVH<Volume>::emit_hierarchy(const std::vector<uint64_t> &codes, std::vector<node_t> &parents,
+                                       std::vector<Node> &nodes)
+{
+    int64_t n = codes.size();
+    Parallel::for_blocks(n - 1, [&](size_t, size_t begin, size_t end)
+    {
+        for (int64_t i = begin; i < static_cast<int64_t>(end); i++)
+        {
+            // direction of the range of the node
+            int d = (delta(codes, i, i + 1) - delta(codes, i, i - 1)) > 0 ? 1 : -1;
+
+            // other end of the range
+            int delta_min = delta(codes, i, i - d);
+            int64_t l_max = 2;
+            while (delta(codes, i, i + l_max * d) > delta_min)
+                l_max *= 2;
+
+            int64_t l = 0;
+            for (int64_t t = l_max / 2; t >= 1; t /= 2)
+                if (delta(codes, i, i + (l + t) * d) > delta_min)
+                    l += t;
+            int64_t j = i + l * d;
+
+            // split position
+            int delta_node = delta(codes, i, j);
+            int64_t s = 0, t = l;
+            do
+            {
+                t = (t + 1) / 2;
+                if (delta(codes, i, i + (s + t) * d) > delta_node)
+                    s += t;
+            } while (t > 1);
+            int64_t gamma = i + s * d + std::min(d, 0);
+
+            Node &node = nodes[i];
+            node.left  = (std::min(i, j) == gamma)     ? (gamma | LEAF_FLAG)       : gamma;
+            node.right = (std::max(i, j) == gamma + 1) ? ((gamma + 1) | LEAF_FLAG) : gamma + 1;
+            node.last_leaf = std::max(i, j);
+
+            parents[(node.left & LEAF_FLAG)  ? (n - 1) + gamma     : gamma]     = i;
+            parents[(node.right & LEAF_FLAG) ? (n - 1) + gamma + 1 : gamma + 1] = i;
+        }
+    });
+}
+
+template <typename Volume>
+void BasicLBVH<Volume>::compute_boxes(const std::vector<node_t> &parents, std::vector<Node> &nodes)
+{
+    size_t n = leaf_boxes_.size();
+    auto child_box = [this, &nodes](node_t child) -> const Volume &
+    {
+        return (child & LEAF_FLAG) ? leaf_boxes_[child & ~LEAF_FLAG] : nodes[child].box;
+    };
+
+    // the second child to arrive at a node computes its box and goes up
+    std::vector<std::atomic<uint32_t>> visits(n - 1);
+    Parallel::for_blocks(n, [&](size_t, size_t begin, size_t end)
+    {
+        for (size_t leaf = begin; leaf < end; leaf++)
+        {
+            node_t node = parents[(n - 1) + leaf];
+            while (visits[node].fetch_add(1, std::memory_order_acq_rel) == 1)
+            {
+                Node &cur = nodes[node];
+                cur.box = child_box(cur.left);
+                cur.box.expand(child_box(cur.right));
+                if (node == 0)
+                    break;
+                node = parents[node];
+            }
+        }
+    });
+}
+
+template class BasicLBVH<Geom::BoundingBox>;
+template class BasicLBVH<Geom::DOP18>;
+
+namespace
+{
+
+template <typename Volume>
+BasicLBVH<Volume> build(const ShapeArray &arr)
+{
+    if constexpr (std::is_same_v<Volume, Geom::BoundingBox>)
+        return BasicLBVH<Volume>{std::vector<Volume>(arr.boxes.begin(), arr.boxes.end())};
+    else
+    {
+        constexpr size_t K = 2 * Volume::N_AXES;
+        std::vector<Volume> boxes;
+        boxes.reserve(arr.size());
+        for (auto &shape : arr.shapes)
+            boxes.push_back(std::visit([](const auto &s)
+            {
+                if constexpr (std::is_same_v<std::decay_t<decltype(s)>, Geom::Point3D>)
+                    return Volume{s};
+                else
+                    return s.template kdop<K>();
+            }, shape));
+        return BasicLBVH<Volume>{boxes};
+    }
+}
+
+} // anonymous namespace
+
+template <typename Volume>
+std::set<index_t> get_inds_with_intscs_lbvh(const ShapeArray &arr, const BasicLBVH<Volume> &bvh, Stats *stats,
+                                            UnionFind *components, const PairFilter &skip)
+{
+    size_t n = arr.size();
+    std::vector<std::atomic<bool>> found(n);
+    std::vector<Stats> thread_stats(Parallel::n_threads());
+
+    bvh.query_self_pairs([&](size_t thr, size_t leaf, size_t other_leaf)
+    {
+        size_t item = bvh.leaf_item(leaf), other = bvh.leaf_item(other_leaf);
+        if (skip && skip(item, other))
+        {
+            thread_stats[thr].pruned++;
+            return;
+        }
+        if (intersects(arr.shapes[item], arr.shapes[other], thread_stats[thr]))
+        {
+            found[leaf].store(true, std::memory_order_relaxed);
+            found[other_leaf].store(true, std::memory_order_relaxed);
+            if (components)
+                components->unite(arr.inds[item], arr.inds[other]);
+        }
+    });
+
+    std::set<index_t> indcs;
+    for (size_t leaf = 0; leaf < n; leaf++)
+        if (found[leaf].load(std::memory_order_relaxed))
+            indcs.insert(arr.inds[bvh.leaf_item(leaf)]);
+
+    if (stats)
+    {
+        *stats = Stats{};
+        for (auto &st : thread_stats)
+            *stats += st;
+    }
+    return indcs;
+}
+
+template <typename Volume>
+std::set<index_t> get_inds_with_intscs_lbvh(const ShapeArray &arr, Stats *stats, UnionFind *components)
+{
+    return get_inds_with_intscs_lbvh(arr, build<Volume>(arr), stats, components);
+}
+
+template <typename Volume>
+void get_inds_with_cross_intscs_lbvh(const ShapeArray &a, const ShapeArray &b, std::set<index_t> &inds_a,
+                                     std::set<index_t> &inds_b, Stats *stats,
+                                     UnionFind *components)
+{
+    BasicLBVH<Volume> bvh_a = build<Volume>(a), bvh_b = build<Volume>(b);
+
+    std::vector<std::atomic<bool>> found_a(a.size()), found_b(b.size());
+    std::vector<Stats> thread_stats(Parallel::n_threads());
+
+    bvh_a.query_pairs(bvh_b, [&](size_t thr, size_t leaf_a, size_t leaf_b)
+    {
+        size_t item_a = bvh_a.leaf_item(leaf_a), item_b = bvh_b.leaf_item(leaf_b);
+        if (intersects(a.shapes[item_a], b.shapes[item_b], thread_stats[thr]))
+        {
+            found_a[leaf_a].store(true, std::memory_order_relaxed);
+            found_b[leaf_b].store(true, std::memory_order_relaxed);
+            if (components)
+                components->unite(a.inds[item_a], b.inds[item_b]);
+        }
+    });
+
+    for (size_t leaf = 0; leaf < a.size(); leaf++)
+        if (found_a[leaf].load(std::memory_order_relaxed))
+            inds_a.insert(a.inds[bvh_a.leaf_item(leaf)]);
+    for (size_t leaf = 0; leaf < b.size(); leaf++)
+        if (found_b[leaf].load(std::memory_order_relaxed))
+            inds_b.insert(b.inds[bvh_b.leaf_item(leaf)]);
+
+    if (stats)
+    {
+        *stats = Stats{};
+        for (auto &st : thread_stats)
+            *stats += st;
+    }
+}
+
+template std::set<index_t> get_inds_with_intscs_lbvh(const ShapeArray &, const LBVH &, Stats *, UnionFind *,
+                                                     const PairFilter &);
+template std::set<index_t> get_inds_with_intscs_lbvh<Geom::BoundingBox>(const ShapeArray &, Stats *, UnionFind *);
+template std::set<index_t> get_inds_with_intscs_lbvh<Geom::DOP18>(const ShapeArray &, Stats *, UnionFind *);
+template void get_inds_with_cross_intscs_lbvh<Geom::BoundingBox>(const ShapeArray &, const ShapeArray &,
+                                                                  std::set<index_t> &, std::set<index_t> &,
+                                                                  Stats *, UnionFind *);
+template void get_inds_with_cross_intscs_lbvh<Geom::DOP18>(const ShapeArray &, const ShapeArray &,
+                                                            std::set<index_t> &, std::set<index_t> &,
+                                                            Stats *, UnionFind *);
+
+} // namespace Driver
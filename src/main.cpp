@@ -1,39 +1,686 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <vector>
 #include <list>
+#include <string>
+#include <iterator>
+#include <optional>
+#include <array>
+#include <chrono>
+#include <cmath>
 
 #include "triangles.hpp"
 #include "driver.hpp"
+#include "scene_file.hpp"
+#include "out_of_core.hpp"
+#include "parallel.hpp"
+#include "mesh.hpp"
+#include "pipeline.hpp"
+#include "verify.hpp"
+#include "dedup.hpp"
+#include "coplanar.hpp"
+#include "union_find.hpp"
+#include "anytime.hpp"
+#include "server.hpp"
+#include "alloc_stats.hpp"
+#include "exact.hpp"
 
-int main()
+namespace
+{
+
+struct Options
+{
+    std::string save_index;  // --save-index FILE: save the parsed scene to FILE
+    std::string load_index;  // --load-index FILE: take the scene from FILE instead of stdin
+    std::string source;      // --source FILE: check that the loaded scene was built from FILE
+    std::optional<Driver::Shard> shard; // --shard ID/COUNT: process only one spatial shard
+    std::optional<std::array<double, 6>> bounds; // --bounds X0,Y0,Z0,X1,Y1,Z1: scene bounds for --shard
+    bool out_of_core = false;           // --out-of-core: input doesn't have to fit in memory
+    Driver::OutOfCore::Params ooc;      // --mem-budget SIZE, --tmp-dir DIR
+    bool ooc_params = false;            // one of them is given
+    bool morton = false;                // --morton: reorder shapes by Morton code before the tests
+    Driver::Engine engine = Driver::Engine::Auto; // --engine auto|brute|tiled|lbvh|lbvh18|bvh8
+    std::string mesh_format;            // --mesh obj|ply: input is an indexed mesh
+    bool ignore_adjacent = false;       // --ignore-adjacent: faces sharing a vertex don't intersect
+    std::string set_b;                  // --set-b FILE: test shapes of stdin (set A) only against FILE
+    bool pipeline = false;              // --pipeline: read and classify shapes on concurrent stages
+    bool verify = false;                // --verify: compare the engine with the brute force
+    Driver::Verify::Params verify_params; // --verify-sample N, --verify-seed N
+    std::string repro_file;             // --repro-file FILE: write the first reproducing pair to FILE
+    bool dedup = false;                 // --dedup: test only one shape of every group of duplicates
+    bool coplanar = false;              // --coplanar: resolve pairs of triangles on one plane in 2D
+    std::string components;             // --components ids|clusters: output connected components
+    std::optional<std::chrono::milliseconds> deadline; // --deadline MS: stream partial results until then
+    std::string serve;                  // --serve SOCKET: keep the scene resident and answer requests
+    bool alloc_stats = false;           // --alloc-stats: report allocations of every stage to stderr
+    bool exact = false;                 // --exact: round coordinates to a grid, test in integers
+    Driver::Exact::Params exact_params; // --grid-step STEP
+};
+
+Driver::Engine parse_engine(const std::string &str)
+{
+    if (str == "auto")  return Driver::Engine::Auto;
+    if (str == "brute") return Driver::Engine::BruteForce;
+    if (str == "tiled") return Driver::Engine::Tiled;
+    if (str == "lbvh")  return Driver::Engine::LBVH;
+    if (str == "lbvh18") return Driver::Engine::LBVH18;
+    if (str == "bvh8")  return Driver::Engine::BVH8;
+    throw std::runtime_error("Unknown engine " + str);
+}
+
+std::string engine_name(Driver::Engine engine)
+{
+    switch (engine)
+    {
+    case Driver::Engine::Auto:       return "auto";
+    case Driver::Engine::BruteForce: return "brute";
+    case Driver::Engine::Tiled:      return "tiled";
+    case Driver::Engine::LBVH:       return "lbvh";
+    case Driver::Engine::LBVH18:     return "lbvh18";
+    case Driver::Engine::BVH8:       return "bvh8";
+    }
+    return "unknown";
+}
+
+std::string parse_components(const std::string &str)
+{
+    if (str == "ids" || str == "clusters")
+        return str;
+    throw std::runtime_error("Unknown components format " + str);
+}
+
+size_t parse_count(const std::string &str)
+{
+    size_t cnt = 0;
+    std::istringstream stream{str};
+    if (!(stream >> cnt) || !stream.eof() || cnt == 0)
+        throw std::runtime_error("Wrong number " + str);
+    return cnt;
+}
+
+
+// 0 is allowed: the search stops at once
+std::chrono::milliseconds parse_ms(const std::string &str)
+{
+    size_t ms = 0;
+    std::istringstream stream{str};
+    if (!(stream >> ms) || !stream.eof())
+        throw std::runtime_error("Wrong number of milliseconds " + str);
+    return std::chrono::milliseconds(ms);
+}
+
+double parse_step(const std::string &str)
+{
+    double step = 0;
+    std::istringstream stream{str};
+    if (!(stream >> step) || !stream.eof() || !(step > 0) || !std::isfinite(step))
+        throw std::runtime_error("Wrong grid step " + str);
+    return step;
+}
+
+// SIZE is a number of bytes with optional K, M or G suffix
+size_t parse_size(const std::string &str)
+{
+    size_t size = 0;
+    std::string suffix;
+    std::istringstream stream{str};
+    if (!(stream >> size) || size == 0)
+        throw std::runtime_error("Wrong size " + str);
+    stream >> suffix;
+
+    if      (suffix == "")  return size;
+    else if (suffix == "K") return size << 10;
+    else if (suffix == "M") return size << 20;
+    else if (suffix == "G") return size << 30;
+    throw std::runtime_error("Wrong size " + str);
+}
+
+Driver::Shard parse_shard(const std::string &str)
+{
+    Driver::Shard shard;
+    char slash = 0;
+    std::istringstream stream{str};
+    if (!(stream >> shard.id >> slash >> shard.count) || slash != '/' || !stream.eof()
+        || shard.count == 0 || shard.id >= shard.count)
+        throw std::runtime_error("Wrong shard, expected ID/COUNT with ID < COUNT");
+    return shard;
+}
+
+std::array<double, 6> parse_bounds(const std::string &str)
+{
+    std::array<double, 6> bounds;
+    std::istringstream stream{str};
+    for (size_t k = 0; k < bounds.size(); k++)
+    {
+        char comma = ',';
+        if ((k && !(stream >> comma)) || comma != ',' || !(stream >> bounds[k]))
+            throw std::runtime_error("Wrong bounds, expected X0,Y0,Z0,X1,Y1,Z1");
+    }
+    if (!stream.eof() && stream.peek() != std::char_traits<char>::eof())
+        throw std::runtime_error("Wrong bounds, expected X0,Y0,Z0,X1,Y1,Z1");
+    for (int axis = 0; axis < 3; axis++)
+        if (!(bounds[axis] <= bounds[3 + axis]))
+            throw std::runtime_error("Wrong bounds, the minimum is above the maximum");
+    return bounds;
+}
+
+Options parse_args(int argc, char *argv[])
+{
+    Options opts;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto next_arg = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for option " + arg);
+            return argv[++i];
+        };
+
+        if      (arg == "--save-index") opts.save_index = next_arg();
+        else if (arg == "--load-index") opts.load_index = next_arg();
+        else if (arg == "--source")     opts.source     = next_arg();
+        else if (arg == "--shard")      opts.shard      = parse_shard(next_arg());
+        else if (arg == "--bounds")     opts.bounds     = parse_bounds(next_arg());
+        else if (arg == "--out-of-core") opts.out_of_core = true;
+        else if (arg == "--mem-budget") {opts.ooc.mem_budget = parse_size(next_arg()); opts.ooc_params = true;}
+        else if (arg == "--tmp-dir")    {opts.ooc.tmp_dir    = next_arg();             opts.ooc_params = true;}
+        else if (arg == "--morton")     opts.morton         = true;
+        else if (arg == "--engine")     opts.engine         = parse_engine(next_arg());
+        else if (arg == "--mesh")       opts.mesh_format    = next_arg();
+        else if (arg == "--ignore-adjacent") opts.ignore_adjacent = true;
+        else if (arg == "--set-b")      opts.set_b          = next_arg();
+        else if (arg == "--pipeline")   opts.pipeline       = true;
+        else if (arg == "--verify")     opts.verify         = true;
+        else if (arg == "--verify-sample") opts.verify_params.sample = parse_count(next_arg());
+        else if (arg == "--verify-seed")   opts.verify_params.seed   = parse_count(next_arg());
+        else if (arg == "--repro-file") opts.repro_file     = next_arg();
+        else if (arg == "--dedup")      opts.dedup          = true;
+        else if (arg == "--coplanar")   opts.coplanar       = true;
+        else if (arg == "--components") opts.components     = parse_components(next_arg());
+        else if (arg == "--deadline")   opts.deadline       = parse_ms(next_arg());
+        else if (arg == "--serve")      opts.serve          = next_arg();
+        else if (arg == "--alloc-stats") opts.alloc_stats   = true;
+        else if (arg == "--exact")      opts.exact          = true;
+        else if (arg == "--grid-step")  opts.exact_params.step = parse_step(next_arg());
+        else if (arg == "--threads")    Driver::Parallel::threads_setting = parse_count(next_arg());
+        else
+            throw std::runtime_error("Unknown option " + arg);
+    }
+    if (opts.bounds && !opts.shard)
+        throw std::runtime_error("--bounds needs --shard");
+    if (opts.shard)
+        opts.shard->bounds = opts.bounds;
+    return opts;
+}
+
+std::string read_all(std::istream &stream)
+{
+    return std::string{std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()};
+}
+
+void read_scene(const Options &opts, std::istream &stream, Driver::ListPoint3D &points,
+                Driver::ListLineSeg3D &linesegs, Driver::ListTriangle3D &triangles)
+{
+    // only the shapes of the shard are kept, they are filtered while the input is streamed
+    if (opts.shard)
+    {
+        Driver::parse_input(points, linesegs, triangles, stream, *opts.shard);
+        return;
+    }
+
+    if (opts.pipeline)
+    {
+        Driver::Pipeline::parse_input(stream, points, linesegs, triangles);
+        return;
+    }
+
+    std::vector<double> inp;
+    Driver::get_input(inp, stream);
+    Driver::parse_input(points, linesegs, triangles, inp);
+}
+
+// ids: the component of every shape, which is the smallest index in it, one per line;
+// clusters: the indices of every component of several shapes on one line, ordered by the first one
+void write_components(std::ostream &out, Driver::UnionFind &components, const std::string &format)
+{
+    size_t n = components.size();
+    if (format == "ids")
+    {
+        for (size_t ind = 0; ind < n; ind++)
+            out << components.find(ind) << '\n';
+        return;
+    }
+
+    std::vector<std::vector<size_t>> members(n);
+    for (size_t ind = 0; ind < n; ind++)
+        members[components.find(ind)].push_back(ind);
+
+    for (auto &cluster : members)
+    {
+        if (cluster.size() < 2)
+            continue;
+        out << cluster[0];
+        for (size_t k = 1; k < cluster.size(); k++)
+            out << ' ' << cluster[k];
+        out << '\n';
+    }
+}
+
+// the indices of the shapes one per line, or the components if they are asked for
+void write_result(const Options &opts, const std::set<Driver::index_t> &indcs, Driver::UnionFind *components)
+{
+    if (components)
+        write_components(std::cout, *components, opts.components);
+    else
+        for (auto ind : indcs)
+        {
+            std::cout << ind << std::endl;
+        }
+}
+
+// the modes which take the shapes as they are and an engine which queries them with a tree of its
+// own, so the shapes need not be put into the lists (the tree comes from a scene file or the pipeline)
+bool queries_shape_array(const Options &opts)
+{
+    return Driver::SceneFile::Mapped::has_tree(opts.engine) && !opts.dedup && !opts.morton && !opts.coplanar
+           && opts.set_b.empty() && !opts.deadline && opts.serve.empty();
+}
+
+// allocations since the previous stage (or since the start) are reported when a stage ends
+class StageAllocs
+{
+    bool on_;
+public:
+    explicit StageAllocs(bool on) : on_(on)
+    {
+        if (!on_)
+            return;
+        Driver::Alloc::reset();
+        Driver::Alloc::enable(true);
+    };
+
+    void end(const std::string &stage)
+    {
+        if (!on_)
+            return;
+        Driver::Alloc::Counters cnt = Driver::Alloc::counters();
+        std::cerr << "Stage " << stage << ": " << cnt.allocs << " allocs, " << cnt.bytes << " bytes, peak "
+                  << cnt.peak << " bytes" << std::endl;
+        Driver::Alloc::reset();
+    };
+
+    void finish()
+    {
+        if (on_)
+            std::cerr << "Peak RSS: " << Driver::Alloc::peak_rss() << " bytes" << std::endl;
+    };
+};
+
+// indices are printed as soon as they are confirmed, so they are not sorted
+void run_anytime(const Options &opts, Driver::ListPoint3D &points, Driver::ListLineSeg3D &linesegs,
+                 Driver::ListTriangle3D &triangles, const std::vector<Driver::DuplicateGroup> &dups)
+{
+    using namespace Driver;
+
+    // duplicates intersect each other, so they are confirmed at once
+    std::set<index_t> printed;
+    auto print = [&printed](index_t ind)
+    {
+        if (printed.insert(ind).second)
+            std::cout << ind << std::endl;
+    };
+    for (auto &group : dups)
+        for (auto ind : group)
+            print(ind);
+
+    Anytime::Report report = Anytime::get_inds_with_intscs(points, linesegs, triangles,
+                                                           Anytime::Params{*opts.deadline}, print);
+    if (report.complete)
+    {
+        std::cout << "Checked all " << report.n_checked << " candidate pairs" << std::endl;
+        return;
+    }
+
+    std::cout << "Deadline expired: checked " << report.n_checked << " candidate pairs" << std::endl;
+
+    std::cout << "Unchecked shapes:";
+    for (auto ind : report.unchecked)
+        if (!printed.count(ind))
+            std::cout << ' ' << ind;
+    std::cout << std::endl;
+}
+
+// returns false if the engines disagree or the engine fails
+bool verify(const Options &opts)
+{
+    using namespace Driver;
+    if (opts.engine == Engine::BruteForce || opts.engine == Engine::Auto)
+        throw std::runtime_error("--verify needs an accelerated engine, e.g. --engine lbvh");
+
+    std::vector<double> inp;
+    get_input(inp, std::cin);
+    Verify::Report report = Verify::verify(inp, opts.engine, opts.verify_params);
+
+    std::string name = engine_name(opts.engine);
+    if (report.engine_error)
+    {
+        std::cout << "Engine " << name << " failed on " << report.n_checked << " of " << report.n_shapes
+                  << " shapes: " << *report.engine_error << std::endl;
+        return false;
+    }
+    std::cout << "Verified " << name << " against brute on " << report.n_checked << " of "
+              << report.n_shapes << " shapes: " << report.mismatches.size() << " mismatches" << std::endl;
+
+    bool repro_written = false;
+    for (auto &mismatch : report.mismatches)
+    {
+        std::cout << "Mismatch: shape " << mismatch.ind << " is reported only by "
+                  << (mismatch.by_engine ? name : "brute") << std::endl;
+        if (!mismatch.repro)
+            continue;
+
+        auto [a, b] = *mismatch.repro;
+        std::cout << "Reproducing pair " << a << " " << b << ":" << std::endl;
+        Verify::write_pair_input(std::cout, inp, *mismatch.repro);
+
+        if (!opts.repro_file.empty() && !repro_written)
+        {
+            std::ofstream repro(opts.repro_file);
+            if (!repro.is_open())
+                throw std::runtime_error("Can't open " + opts.repro_file);
+            Verify::write_pair_input(repro, inp, *mismatch.repro);
+            repro_written = true;
+        }
+    }
+    return report.mismatches.empty();
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
 {
     try
-    {   
+    {
         using namespace Driver;
 
-        std::vector<double> inp;
-        get_input(inp, std::cin);
+        Options opts = parse_args(argc, argv);
+
+        // stdin isn't read through C stdio, which locks on every char once there are several threads
+        std::ios_base::sync_with_stdio(false);
+
+        // chunks are tested by the engine on the input as it is
+        if (opts.out_of_core && (opts.verify || !opts.mesh_format.empty() || opts.shard || opts.dedup || opts.morton
+                                 || opts.pipeline || opts.coplanar || !opts.save_index.empty()
+                                 || !opts.load_index.empty()))
+            throw std::runtime_error("--out-of-core can't be used with --verify, --mesh, --shard, --dedup, --morton, "
+                                     "--pipeline, --coplanar, --save-index and --load-index");
+
+        // faces of a mesh are tested with an LBVH of their own, they aren't the shapes of the input
+        if (!opts.mesh_format.empty() && (opts.verify || opts.shard || opts.dedup || opts.morton || opts.pipeline
+                                          || opts.coplanar || !opts.save_index.empty() || !opts.load_index.empty()))
+            throw std::runtime_error("--mesh can't be used with --verify, --shard, --dedup, --morton, --pipeline, "
+                                     "--coplanar, --save-index and --load-index");
+
+        if (opts.ignore_adjacent && opts.mesh_format.empty())
+            throw std::runtime_error("--ignore-adjacent needs --mesh");
+
+        if (opts.ooc_params && !opts.out_of_core)
+            throw std::runtime_error("--mem-budget and --tmp-dir need --out-of-core");
+
+        if (!opts.components.empty()
+            && (opts.out_of_core || opts.verify || !opts.mesh_format.empty() || opts.shard || !opts.set_b.empty()))
+            throw std::runtime_error("--components can't be used with --out-of-core, --verify, --mesh, --shard and --set-b");
+
+        if (opts.deadline && (opts.out_of_core || opts.verify || !opts.mesh_format.empty() || !opts.set_b.empty()
+                              || !opts.components.empty() || opts.coplanar))
+            throw std::runtime_error("--deadline can't be used with --out-of-core, --verify, --mesh, --set-b, "
+                                     "--components and --coplanar");
+
+        if (!opts.serve.empty() && (opts.out_of_core || opts.verify || !opts.mesh_format.empty() || opts.shard
+                                    || !opts.set_b.empty() || opts.dedup || opts.coplanar
+                                    || !opts.components.empty() || opts.deadline))
+            throw std::runtime_error("--serve can't be used with --out-of-core, --verify, --mesh, --shard, --set-b, "
+                                     "--dedup, --coplanar, --components and --deadline");
+
+        if (opts.alloc_stats && (opts.verify || !opts.mesh_format.empty() || !opts.serve.empty() || opts.deadline))
+            throw std::runtime_error("--alloc-stats can't be used with --verify, --mesh, --serve and --deadline");
+
+        if (!opts.set_b.empty() && (opts.out_of_core || opts.verify || !opts.mesh_format.empty() || opts.coplanar
+                                    || opts.shard || !opts.save_index.empty()))
+            throw std::runtime_error("--set-b can't be used with --out-of-core, --verify, --mesh, --coplanar, "
+                                     "--shard and --save-index");
+
+        // the brute force side of the comparison runs on the input as it is
+        if (opts.verify && (opts.dedup || opts.coplanar || opts.morton || opts.pipeline))
+            throw std::runtime_error("--verify can't be used with --dedup, --coplanar, --morton and --pipeline");
+
+        if (opts.exact_params.step > 0 && !opts.exact)
+            throw std::runtime_error("--grid-step needs --exact");
+
+        if (opts.exact && (opts.out_of_core || opts.verify || !opts.mesh_format.empty() || opts.shard
+                           || !opts.set_b.empty() || opts.pipeline || opts.dedup || opts.coplanar || opts.deadline
+                           || !opts.serve.empty() || opts.alloc_stats || !opts.save_index.empty()
+                           || !opts.load_index.empty()))
+            throw std::runtime_error("--exact can be used only with --components and --threads");
+
+        if (opts.exact)
+        {
+            std::vector<double> inp;
+            get_input(inp, std::cin);
+            std::optional<UnionFind> components;
+            if (!opts.components.empty())
+                components.emplace(inp.size() / 9);
+
+            std::set<index_t> indcs = Exact::get_inds_with_intscs(inp, opts.exact_params, nullptr,
+                                                                  components ? &*components : nullptr);
+            if (components)
+                write_components(std::cout, *components, opts.components);
+            else
+                for (auto ind : indcs)
+                    std::cout << ind << std::endl;
+            return 0;
+        }
+
+        if (opts.out_of_core)
+        {
+            StageAllocs allocs{opts.alloc_stats};
+            OutOfCore::Params params = opts.ooc;
+            params.engine = opts.engine;
+            OutOfCore::get_inds_with_intscs(std::cin, std::cout, params);
+            allocs.end("out_of_core");
+            allocs.finish();
+            return 0;
+        }
+
+        if (opts.verify)
+            return verify(opts) ? 0 : 1;
+
+        if (!opts.mesh_format.empty())
+        {
+            Mesh mesh;
+            if (opts.mesh_format == "obj")
+                mesh = read_obj(std::cin);
+            else if (opts.mesh_format == "ply")
+                mesh = read_ply(std::cin);
+            else
+                throw std::runtime_error("Unknown mesh format " + opts.mesh_format);
+
+            for (auto ind : get_faces_with_intscs(mesh, opts.ignore_adjacent))
+                std::cout << ind << std::endl;
+            return 0;
+        }
+
+        // a scene file holds the whole scene, already parsed
+        if (!opts.load_index.empty() && (opts.shard || opts.pipeline))
+            throw std::runtime_error("--load-index can't be used with --shard and --pipeline");
+
+        StageAllocs allocs{opts.alloc_stats};
 
         ListPoint3D points;
         ListLineSeg3D linesegs;
         ListTriangle3D triangles;
-        parse_input(points, linesegs, triangles, inp);
-        
-        std::set<index_t> indcs = get_inds_with_intscs(points, linesegs, triangles);
 
-        for (auto ind : indcs)
+        if (!opts.load_index.empty())
         {
-            std::cout << ind << std::endl;
+            SceneFile::Mapped scene{opts.load_index};
+            if (!opts.source.empty())
+            {
+                std::ifstream src_file(opts.source, std::ios::binary);
+                if (!src_file.is_open())
+                    throw std::runtime_error("Can't open source file");
+                std::string src = read_all(src_file);
+                if (SceneFile::checksum(src.data(), src.size()) != scene.header().src_checksum)
+                    throw SceneFile::WrongSceneFile("Scene file is outdated: source checksum mismatch");
+            }
+
+            // the shapes and the trees of the file are queried in place, unless the mode changes
+            // the shapes or takes an engine without a tree there
+            if (queries_shape_array(opts))
+            {
+                allocs.end("read");
+                std::optional<UnionFind> components;
+                if (!opts.components.empty())
+                    components.emplace(scene.header().n_shapes());
+                std::set<index_t> indcs = scene.get_inds_with_intscs(opts.engine, nullptr,
+                                                                     components ? &*components : nullptr);
+                allocs.end("engine");
+                write_result(opts, indcs, components ? &*components : nullptr);
+                allocs.end("output");
+                allocs.finish();
+                return 0;
+            }
+            scene.load(points, linesegs, triangles);
+        }
+        else if (!opts.save_index.empty())
+        {
+            std::string src = read_all(std::cin);
+            std::istringstream src_stream{src};
+            read_scene(opts, src_stream, points, linesegs, triangles);
+
+            SceneFile::save(opts.save_index, SceneFile::checksum(src.data(), src.size()),
+                            points, linesegs, triangles);
+        }
+        else if (opts.pipeline && !opts.shard && queries_shape_array(opts))
+        {
+            // the boxes and the bounds of their centers come from the broad phase stage
+            Pipeline::Scene scene = Pipeline::parse_scene(std::cin);
+            allocs.end("read");
+            LBVH lbvh{scene.boxes, scene.center_bounds};
+            ShapeArray arr{Storage<index_t>{std::move(scene.inds)}, Storage<Shape>{std::move(scene.shapes)},
+                           Storage<Geom::BoundingBox>{std::move(scene.boxes)}};
+            std::optional<UnionFind> components;
+            if (!opts.components.empty())
+                components.emplace(arr.size());
+            UnionFind *uf = components ? &*components : nullptr;
+            // as with a scene file, Auto takes BVH8
+            std::set<index_t> indcs = (opts.engine == Engine::LBVH)
+                                    ? get_inds_with_intscs_lbvh(arr, lbvh, nullptr, uf)
+                                    : get_inds_with_intscs_bvh8(arr, BVH8{lbvh}, nullptr, uf);
+            allocs.end("engine");
+            write_result(opts, indcs, uf);
+            allocs.end("output");
+            allocs.finish();
+            return 0;
+        }
+        else
+            read_scene(opts, std::cin, points, linesegs, triangles);
+        allocs.end("read");
+
+        if (!opts.serve.empty())
+        {
+            Server::Scene scene{points, linesegs, triangles};
+            points.clear();
+            linesegs.clear();
+            triangles.clear();
+            Server::serve(scene, opts.serve);
+            return 0;
         }
+
+        // all shapes are in the lists here, every index is below their count
+        size_t n_shapes = points.size() + linesegs.size() + triangles.size();
+
+        std::vector<DuplicateGroup> dups;
+        if (opts.dedup)
+        {
+            dups = remove_duplicates(points, linesegs, triangles);
+            allocs.end("dedup");
+        }
+
+        if (opts.morton)
+        {
+            reorder_morton(points, linesegs, triangles);
+            allocs.end("morton");
+        }
+
+        if (opts.deadline)
+        {
+            run_anytime(opts, points, linesegs, triangles, dups);
+            return 0;
+        }
+
+        if (!opts.set_b.empty())
+        {
+            Shapes a{std::move(points), std::move(linesegs), std::move(triangles)}, b;
+            std::ifstream file_b(opts.set_b);
+            if (!file_b.is_open())
+                throw std::runtime_error("Can't open " + opts.set_b);
+            read_scene(opts, file_b, b.points, b.linesegs, b.triangles);
+            std::vector<DuplicateGroup> dups_b;
+            if (opts.dedup)
+                dups_b = remove_duplicates(b.points, b.linesegs, b.triangles);
+            if (opts.morton)
+                reorder_morton(b.points, b.linesegs, b.triangles);
+            allocs.end("read_b");
+
+            std::set<index_t> inds_a, inds_b;
+            get_inds_with_cross_intscs(a, b, inds_a, inds_b, opts.engine);
+            // duplicates in one set don't intersect each other in this mode
+            restore_duplicates(dups, inds_a, false);
+            restore_duplicates(dups_b, inds_b, false);
+            allocs.end("engine");
+
+            for (auto ind : inds_a)
+                std::cout << "A " << ind << std::endl;
+            for (auto ind : inds_b)
+                std::cout << "B " << ind << std::endl;
+            allocs.end("output");
+            allocs.finish();
+            return 0;
+        }
+
+        std::optional<UnionFind> components;
+        if (!opts.components.empty())
+        {
+            components.emplace(n_shapes);
+            // duplicates intersect each other, so the representative's component is theirs too
+            for (auto &group : dups)
+                for (auto ind : group)
+                    components->unite(group.front(), ind);
+        }
+        UnionFind *uf = components ? &*components : nullptr;
+
+        std::set<index_t> indcs = opts.coplanar
+                                ? get_inds_with_intscs_coplanar(points, linesegs, triangles, opts.engine, nullptr, uf)
+                                : get_inds_with_intscs(points, linesegs, triangles, opts.engine, nullptr, uf);
+        restore_duplicates(dups, indcs);
+        allocs.end("engine");
+
+        write_result(opts, indcs, uf);
+        allocs.end("output");
+        allocs.finish();
     }
     catch(const std::logic_error& e)
     {
         std::cerr << "LOGIC ERROR: " << e.what() << std::endl;
+        return 1;
     }
     catch(const std::exception& e)
     {
         std::cerr << e.what() << '\n';
+        return 1;
     }
- 
+
     return 0;
 }
@@ -0,0 +1,370 @@
+#include "mesh.hpp"
+#include "lbvh.hpp"
+#include "parallel.hpp"
+
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+
+namespace Driver
+{
+
+namespace
+{
+
+// adds polygon as a fan of triangles
+void add_polygon(Mesh &mesh, const std::vector<uint32_t> &polygon)
+{
+    if (polygon.size() < 3)
+        throw WrongMeshInput("face with less than 3 vertices");
+
+    for (size_t k = 1; k + 1 < polygon.size(); k++)
+        mesh.faces.push_back({polygon[0], polygon[k], polygon[k + 1]});
+}
+
+void check_faces(const Mesh &mesh)
+{
+    for (auto &face : mesh.faces)
+        for (auto vert : face)
+            if (vert >= mesh.vertices.size())
+                throw WrongMeshInput("face references a missing vertex");
+}
+
+// 'i', 'i/t', 'i//n' or 'i/t/n' with 1-based or negative (relative) vertex index i
+uint32_t parse_obj_index(const std::string &token, size_t n_vertices)
+{
+    const char *str = token.c_str();
+    char *end = nullptr;
+    long ind = std::strtol(str, &end, 10);
+    if (end == str || (*end != '\0' && *end != '/') || ind == 0)
+        throw WrongMeshInput("bad face index '" + token + "'");
+
+    if (ind < 0)
+    {
+        if (static_cast<size_t>(-ind) > n_vertices)
+            throw WrongMeshInput("face references a missing vertex");
+        return n_vertices + ind;
+    }
+    return ind - 1;
+}
+
+enum class PlyFormat {Ascii, BinaryLE, BinaryBE};
+enum class PlyType {Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64};
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type;
+    bool is_list = false;
+    PlyType count_type = PlyType::UInt8;
+};
+
+struct PlyElement
+{
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> props;
+};
+
+PlyType parse_ply_type(const std::string &str)
+{
+    if (str == "char"   || str == "int8")    return PlyType::Int8;
+    if (str == "uchar"  || str == "uint8")   return PlyType::UInt8;
+    if (str == "short"  || str == "int16")   return PlyType::Int16;
+    if (str == "ushort" || str == "uint16")  return PlyType::UInt16;
+    if (str == "int"    || str == "int32")   return PlyType::Int32;
+    if (str == "uint"   || str == "uint32")  return PlyType::UInt32;
+    if (str == "float"  || str == "float32") return PlyType::Float32;
+    if (str == "double" || str == "float64") return PlyType::Float64;
+    throw WrongMeshInput("unknown PLY type '" + str + "'");
+}
+
+size_t ply_type_size(PlyType type)
+{
+    switch (type)
+    {
+    case PlyType::Int8:  case PlyType::UInt8:   return 1;
+    case PlyType::Int16: case PlyType::UInt16:  return 2;
+    case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+    case PlyType::Float64: return 8;
+    }
+    return 0;
+}
+
+template <typename T>
+T from_bytes(const unsigned char *bytes)
+{
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+double read_ply_value(std::istream &stream, PlyType type, PlyFormat format)
+{
+    if (format == PlyFormat::Ascii)
+    {
+        double value = 0;
+        if (!(stream >> value))
+            throw WrongMeshInput("unexpected end of PLY data");
+        return value;
+    }
+
+    unsigned char bytes[8];
+    size_t size = ply_type_size(type);
+    if (!stream.read(reinterpret_cast<char *>(bytes), size))
+        throw WrongMeshInput("unexpected end of PLY data");
+
+    const uint16_t one = 1;
+    bool host_le = *reinterpret_cast<const unsigned char *>(&one) == 1;
+    if ((format == PlyFormat::BinaryLE) != host_le)
+        std::reverse(bytes, bytes + size);
+
+    switch (type)
+    {
+    case PlyType::Int8:    return from_bytes<int8_t>(bytes);
+    case PlyType::UInt8:   return from_bytes<uint8_t>(bytes);
+    case PlyType::Int16:   return from_bytes<int16_t>(bytes);
+    case PlyType::UInt16:  return from_bytes<uint16_t>(bytes);
+    case PlyType::Int32:   return from_bytes<int32_t>(bytes);
+    case PlyType::UInt32:  return from_bytes<uint32_t>(bytes);
+    case PlyType::Float32: return from_bytes<float>(bytes);
+    case PlyType::Float64: return from_bytes<double>(bytes);
+    }
+    return 0;
+}
+
+std::vector<PlyElement> read_ply_header(std::istream &stream, PlyFormat &format)
+{
+    std::string line;
+    if (!std::getline(stream, line) || line.substr(0, 3) != "ply")
+        throw WrongMeshInput("not a PLY file");
+
+    std::vector<PlyElement> elements;
+    bool has_format = false;
+    while (std::getline(stream, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        std::istringstream words{line};
+        std::string keyword;
+        if (!(words >> keyword) || keyword == "comment" || keyword == "obj_info")
+            continue;
+
+        if (keyword == "end_header")
+        {
+            if (!has_format)
+                throw WrongMeshInput("PLY format is not specified");
+            return elements;
+        }
+
+        if (keyword == "format")
+        {
+            std::string fmt;
+            words >> fmt;
+            if      (fmt == "ascii")                format = PlyFormat::Ascii;
+            else if (fmt == "binary_little_endian") format = PlyFormat::BinaryLE;
+            else if (fmt == "binary_big_endian")    format = PlyFormat::BinaryBE;
+            else
+                throw WrongMeshInput("unknown PLY format '" + fmt + "'");
+            has_format = true;
+        }
+        else if (keyword == "element")
+        {
+            PlyElement elem;
+            if (!(words >> elem.name >> elem.count))
+                throw WrongMeshInput("bad PLY element");
+            elements.push_back(elem);
+        }
+        else if (keyword == "property")
+        {
+            if (elements.empty())
+                throw WrongMeshInput("PLY property without element");
+
+            PlyProperty prop;
+            std::string type;
+            words >> type;
+            if (type == "list")
+            {
+                std::string count_type;
+                words >> count_type >> type;
+                prop.is_list = true;
+                prop.count_type = parse_ply_type(count_type);
+            }
+            prop.type = parse_ply_type(type);
+            if (!(words >> prop.name))
+                throw WrongMeshInput("bad PLY property");
+            elements.back().props.push_back(prop);
+        }
+        else
+            throw WrongMeshInput("unknown PLY header line '" + line + "'");
+    }
+    throw WrongMeshInput("PLY header is not terminated");
+}
+
+} // anonymous namespace
+
+Mesh read_obj(std::istream &stream)
+{
+    Mesh mesh;
+    std::string line;
+    std::vector<uint32_t> polygon;
+    while (std::getline(stream, line))
+    {
+        std::istringstream words{line};
+        std::string tag;
+        if (!(words >> tag))
+            continue;
+
+        if (tag == "v")
+        {
+            double x = 0, y = 0, z = 0;
+            if (!(words >> x >> y >> z))
+                throw WrongMeshInput("bad vertex '" + line + "'");
+            mesh.vertices.emplace_back(x, y, z);
+        }
+        else if (tag == "f")
+        {
+            polygon.clear();
+            std::string token;
+            while (words >> token)
+                polygon.push_back(parse_obj_index(token, mesh.vertices.size()));
+            add_polygon(mesh, polygon);
+        }
+    }
+
+    check_faces(mesh);
+    return mesh;
+}
+
+Mesh read_ply(std::istream &stream)
+{
+    PlyFormat format = PlyFormat::Ascii;
+    std::vector<PlyElement> elements = read_ply_header(stream, format);
+
+    Mesh mesh;
+    std::vector<uint32_t> polygon;
+    for (auto &elem : elements)
+    {
+        bool is_vertex = elem.name == "vertex", is_face = elem.name == "face";
+        if (is_vertex)
+            mesh.vertices.reserve(elem.count);
+
+        for (size_t i = 0; i < elem.count; i++)
+        {
+            double coords[3] = {0, 0, 0};
+            int n_coords = 0;
+            polygon.clear();
+
+            for (auto &prop : elem.props)
+            {
+                if (prop.is_list)
+                {
+                    size_t count = read_ply_value(stream, prop.count_type, format);
+                    bool is_indices = is_face && (prop.name == "vertex_indices" || prop.name == "vertex_index");
+                    for (size_t k = 0; k < count; k++)
+                    {
+                        double value = read_ply_value(stream, prop.type, format);
+                        if (is_indices)
+                        {
+                            if (value < 0)
+                                throw WrongMeshInput("face references a missing vertex");
+                            polygon.push_back(static_cast<uint32_t>(value));
+                        }
+                    }
+                    continue;
+                }
+
+                double value = read_ply_value(stream, prop.type, format);
+                if (is_vertex && prop.name.size() == 1 && prop.name[0] >= 'x' && prop.name[0] <= 'z')
+                {
+                    coords[prop.name[0] - 'x'] = value;
+                    n_coords++;
+                }
+            }
+
+            if (is_vertex)
+            {
+                if (n_coords != 3)
+                    throw WrongMeshInput("PLY vertex must have x, y and z");
+                mesh.vertices.emplace_back(coords[0], coords[1], coords[2]);
+            }
+            if (is_face)
+                add_polygon(mesh, polygon);
+        }
+    }
+
+    check_faces(mesh);
+    return mesh;
+}
+
+namespace
+{
+
+bool share_vertex(const std::array<uint32_t, 3> &a, const std::array<uint32_t, 3> &b)
+{
+    for (auto va : a)
+        for (auto vb : b)
+            if (va == vb)
+                return true;
+    return false;
+}
+
+Shape face_shape(const Mesh &mesh, size_t face)
+{
+    auto &f = mesh.faces[face];
+    auto &verts = mesh.vertices;
+    return with_shape(verts[f[0]], verts[f[1]], verts[f[2]], [](const auto &shape) {return Shape{shape};});
+}
+
+} // anonymous namespace
+
+std::set<index_t> get_faces_with_intscs(const Mesh &mesh, bool ignore_adjacent, Stats *stats)
+{
+    check_faces(mesh);
+
+    size_t n = mesh.faces.size();
+    std::vector<Geom::BoundingBox> boxes;
+    boxes.reserve(n);
+    for (auto &face : mesh.faces)
+        boxes.push_back(Geom::BoundingBox{mesh.vertices[face[0]], mesh.vertices[face[1]], mesh.vertices[face[2]]});
+
+    LBVH bvh{boxes};
+
+    std::vector<std::atomic<bool>> found(n);
+    std::vector<Stats> thread_stats(Parallel::n_threads());
+
+    // a face may degenerate into a line segment or a point
+    bvh.query_self_pairs([&](size_t thr, size_t leaf, size_t other_leaf)
+    {
+        size_t face = bvh.leaf_item(leaf), other = bvh.leaf_item(other_leaf);
+        if (ignore_adjacent && share_vertex(mesh.faces[face], mesh.faces[other]))
+        {
+            thread_stats[thr].pruned++;
+            return;
+        }
+
+        if (intersects(face_shape(mesh, face), face_shape(mesh, other), thread_stats[thr]))
+        {
+            found[face].store(true, std::memory_order_relaxed);
+            found[other].store(true, std::memory_order_relaxed);
+        }
+    });
+
+    std::set<index_t> indcs;
+    for (size_t face = 0; face < n; face++)
+        if (found[face].load(std::memory_order_relaxed))
+            indcs.insert(face);
+
+    if (stats)
+    {
+        *stats = Stats{};
+        for (auto &st : thread_stats)
+            *stats += st;
+    }
+    return indcs;
+}
+
+} // namespace Driver
@@ -0,0 +1,333 @@
+#include "out_of_core.hpp"
+#include "morton.hpp"
+#include "lbvh.hpp"
+
+#include <fstream>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <filesystem>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <tuple>
+
+namespace Driver
+{
+
+namespace OutOfCore
+{
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+struct Record
+{
+    uint64_t key; // Morton code of the centroid
+    uint64_t ind;
+    double coords[9];
+};
+
+// approximate working memory of a tree engine per shape, at most that of the LBVH over 18-DOPs:
+// the volumes passed to the build, the sorted ones and the nodes, the Morton codes with the sort buffers
+const size_t TREE_MEM = 3 * sizeof(LBVH18::Node) + 4 * sizeof(uint64_t);
+
+// approximate memory taken by one shape of a loaded chunk: its element of the ShapeArray, the
+// engine working memory and a node of the set of found indices
+const size_t SHAPE_MEM = sizeof(Shape) + sizeof(Geom::BoundingBox) + sizeof(index_t) + TREE_MEM
+                       + sizeof(index_t) + 4 * sizeof(void *);
+
+// records read at once by load_chunk
+const size_t LOAD_BLOCK = 4096;
+
+// max number of runs merged at once, bounds the number of open files
+const size_t MERGE_FANIN = 64;
+
+struct Bounds
+{
+    double min[3] = { INFINITY,  INFINITY,  INFINITY};
+    double max[3] = {-INFINITY, -INFINITY, -INFINITY};
+
+    void add(const double *coords, size_t n_points)
+    {
+        for (size_t i = 0; i < n_points * 3; i++)
+        {
+            min[i % 3] = std::min(min[i % 3], coords[i]);
+            max[i % 3] = std::max(max[i % 3], coords[i]);
+        }
+    }
+
+    bool intersects(const Bounds &other) const
+    {
+        for (int axis = 0; axis < 3; axis++)
+            if (!Geom::leq(min[axis], other.max[axis]) || !Geom::leq(other.min[axis], max[axis]))
+                return false;
+        return true;
+    }
+};
+
+struct Chunk
+{
+    uint64_t first; // index of the first record in the sorted file
+    uint64_t count;
+    Bounds bounds;
+};
+
+// temporary directory, removed with all its content
+class TmpDir final
+{
+private:
+    fs::path path_;
+public:
+    explicit TmpDir(const std::string &parent)
+    {
+        std::string templ = (fs::path{parent} / "triangles_ooc_XXXXXX").string();
+        if (!mkdtemp(templ.data()))
+            throw std::runtime_error("Can't create temporary directory");
+        path_ = templ;
+    }
+    ~TmpDir()
+    {
+        std::error_code ec;
+        fs::remove_all(path_, ec);
+    }
+    TmpDir(const TmpDir &) = delete;
+    TmpDir &operator=(const TmpDir &) = delete;
+
+    fs::path file(const std::string &name) const {return path_ / name;};
+};
+
+std::ofstream open_out(const fs::path &path)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        throw std::runtime_error("Can't create temporary file");
+    return file;
+}
+
+std::ifstream open_in(const fs::path &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Can't open temporary file");
+    return file;
+}
+
+void write_records(std::ofstream &file, const Record *recs, size_t n)
+{
+    file.write(reinterpret_cast<const char *>(recs), n * sizeof(Record));
+    if (!file)
+        throw std::runtime_error("Can't write temporary file");
+}
+
+// reads up to n records, returns the number of records read
+size_t read_records(std::ifstream &file, Record *recs, size_t n)
+{
+    file.read(reinterpret_cast<char *>(recs), n * sizeof(Record));
+    return file.gcount() / sizeof(Record);
+}
+
+bool operator<(const Record &lhs, const Record &rhs)
+{
+    return std::tie(lhs.key, lhs.ind) < std::tie(rhs.key, rhs.ind);
+}
+
+// streams the text input into the raw (unsorted) file, same checks as Driver::get_input
+uint64_t stream_input(std::istream &in, const fs::path &raw_path, Bounds &bounds)
+{
+    int N_inp = 0;
+    in >> N_inp;
+    if (!in.good() || N_inp <= 0)
+        throw std::runtime_error("Wrong input");
+
+    std::ofstream raw = open_out(raw_path);
+    Record rec{};
+    for (uint64_t ind = 0; ind < static_cast<uint64_t>(N_inp); ind++)
+    {
+        rec.ind = ind;
+        for (double &coord : rec.coords)
+            if (!(in >> coord))
+                throw std::runtime_error("Not full input");
+
+        bounds.add(rec.coords, 3);
+        write_records(raw, &rec, 1);
+    }
+    return N_inp;
+}
+
+// sorted runs of at most 'run_size' records each
+std::vector<fs::path> make_runs(const TmpDir &tmp, const fs::path &raw_path, const Bounds &bounds, size_t run_size)
+{
+    MortonGrid grid{bounds.min, bounds.max};
+    std::ifstream raw = open_in(raw_path);
+    std::vector<Record> run(run_size);
+    std::vector<fs::path> runs;
+
+    size_t n = 0;
+    while ((n = read_records(raw, run.data(), run_size)) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            const double *c = run[i].coords;
+            run[i].key = grid.code((c[0] + c[3] + c[6]) / 3, (c[1] + c[4] + c[7]) / 3, (c[2] + c[5] + c[8]) / 3);
+        }
+        std::sort(run.begin(), run.begin() + n);
+
+        runs.push_back(tmp.file("run_" + std::to_string(runs.size())));
+        std::ofstream out = open_out(runs.back());
+        write_records(out, run.data(), n);
+    }
+    return runs;
+}
+
+void merge_group(const std::vector<fs::path> &group, const fs::path &out_path)
+{
+    std::vector<std::ifstream> files;
+    for (auto &path : group)
+        files.push_back(open_in(path));
+
+    using Head = std::pair<Record, size_t>; // record and number of its file
+    auto greater = [](const Head &lhs, const Head &rhs) {return rhs.first < lhs.first;};
+    std::priority_queue<Head, std::vector<Head>, decltype(greater)> heads(greater);
+
+    Record rec{};
+    for (size_t i = 0; i < files.size(); i++)
+        if (read_records(files[i], &rec, 1))
+            heads.push({rec, i});
+
+    std::ofstream out = open_out(out_path);
+    while (!heads.empty())
+    {
+        auto [top, i] = heads.top();
+        heads.pop();
+        write_records(out, &top, 1);
+        if (read_records(files[i], &rec, 1))
+            heads.push({rec, i});
+    }
+}
+
+// merges the runs in several passes if needed, returns path to the sorted file
+fs::path merge_runs(const TmpDir &tmp, std::vector<fs::path> runs)
+{
+    size_t pass = 0;
+    while (runs.size() > 1)
+    {
+        std::vector<fs::path> merged;
+        for (size_t first = 0; first < runs.size(); first += MERGE_FANIN)
+        {
+            std::vector<fs::path> group(runs.begin() + first,
+                                        runs.begin() + std::min(first + MERGE_FANIN, runs.size()));
+            merged.push_back(tmp.file("merged_" + std::to_string(pass) + "_" + std::to_string(merged.size())));
+            merge_group(group, merged.back());
+            for (auto &path : group)
+                fs::remove(path);
+        }
+        runs = std::move(merged);
+        pass++;
+    }
+    return runs.front();
+}
+
+std::vector<Chunk> split_into_chunks(const fs::path &sorted_path, size_t chunk_size)
+{
+    std::ifstream sorted = open_in(sorted_path);
+    std::vector<Chunk> chunks;
+    Record rec{};
+    uint64_t ind = 0;
+    while (read_records(sorted, &rec, 1))
+    {
+        if (chunks.empty() || chunks.back().count == chunk_size)
+            chunks.push_back(Chunk{ind, 0, Bounds{}});
+        chunks.back().count++;
+        chunks.back().bounds.add(rec.coords, 3);
+        ind++;
+    }
+    return chunks;
+}
+
+// the records are read by blocks, so the chunk takes only the memory of its array
+ShapeArray load_chunk(const fs::path &sorted_path, const Chunk &chunk)
+{
+    std::ifstream sorted = open_in(sorted_path);
+    sorted.seekg(chunk.first * sizeof(Record));
+
+    std::vector<index_t> inds;
+    std::vector<Shape> shapes;
+    inds.reserve(chunk.count);
+    shapes.reserve(chunk.count);
+
+    std::vector<Record> block(std::min<uint64_t>(chunk.count, LOAD_BLOCK));
+    for (uint64_t left = chunk.count; left;)
+    {
+        size_t n = std::min<uint64_t>(left, block.size());
+        if (read_records(sorted, block.data(), n) != n)
+            throw std::runtime_error("Can't read temporary file");
+
+        for (size_t k = 0; k < n; k++)
+        {
+            const double *c = block[k].coords;
+            Geom::Point3D p1{c[0], c[1], c[2]}, p2{c[3], c[4], c[5]}, p3{c[6], c[7], c[8]};
+            inds.push_back(block[k].ind);
+            with_shape(p1, p2, p3, [&](const auto &shape) {shapes.emplace_back(shape);});
+        }
+        left -= n;
+    }
+    return make_shape_array(std::move(inds), std::move(shapes));
+}
+
+} // anonymous namespace
+
+void get_inds_with_intscs(std::istream &in, std::ostream &out, const Params &params, Stats *stats)
+{
+    size_t run_size = std::max<size_t>(params.mem_budget / sizeof(Record), 1);
+    size_t chunk_size = std::max<size_t>(params.mem_budget / (2 * SHAPE_MEM), 1);
+
+    TmpDir tmp{params.tmp_dir};
+
+    Bounds bounds;
+    uint64_t n_shapes = stream_input(in, tmp.file("raw"), bounds);
+
+    std::vector<fs::path> runs = make_runs(tmp, tmp.file("raw"), bounds, run_size);
+    fs::remove(tmp.file("raw"));
+
+    fs::path sorted_path = merge_runs(tmp, runs);
+    std::vector<Chunk> chunks = split_into_chunks(sorted_path, chunk_size);
+
+    std::vector<bool> found(n_shapes, false);
+    auto mark = [&found](const std::set<index_t> &inds) {for (auto ind : inds) found[ind] = true;};
+
+    Stats total;
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        ShapeArray chunk = load_chunk(sorted_path, chunks[i]);
+
+        Stats st;
+        mark(Driver::get_inds_with_intscs(chunk, params.engine, &st));
+        total += st;
+
+        for (size_t j = i + 1; j < chunks.size(); j++)
+        {
+            if (!chunks[i].bounds.intersects(chunks[j].bounds))
+                continue;
+
+            ShapeArray other = load_chunk(sorted_path, chunks[j]);
+            std::set<index_t> inds_chunk, inds_other;
+            get_inds_with_cross_intscs(chunk, other, inds_chunk, inds_other, params.engine, &st);
+            total += st;
+            mark(inds_chunk);
+            mark(inds_other);
+        }
+    }
+
+    for (uint64_t ind = 0; ind < n_shapes; ind++)
+        if (found[ind])
+            out << ind << std::endl;
+
+    if (stats) *stats = total;
+}
+
+} // namespace OutOfCore
+
+} // namespace Driver
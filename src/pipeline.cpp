@@ -0,0 +1,208 @@
+#include "pipeline.hpp"
+#include "spsc_queue.hpp"
+
+#include <vector>
+#include <thread>
+#include <exception>
+#include <algorithm>
+#include <cmath>
+#include <variant>
+#include <type_traits>
+
+namespace Driver
+{
+
+namespace Pipeline
+{
+
+namespace
+{
+
+struct RawBatch
+{
+    index_t first = 0;          // index of the first shape of the batch
+    std::vector<double> coords; // 9 numbers per shape
+};
+
+struct ShapeBatch
+{
+    std::vector<index_t> inds;
+    std::vector<Shape> shapes;
+    std::vector<Geom::BoundingBox> boxes;
+    std::array<double, 6> center_bounds{INFINITY, INFINITY, INFINITY, -INFINITY, -INFINITY, -INFINITY};
+};
+
+void read_stage(std::istream &stream, size_t batch_size, SPSCQueue<RawBatch> &out)
+{
+    int N_inp = 0;
+    stream >> N_inp;
+    if (!stream.good() || N_inp <= 0)
+        throw std::runtime_error("Wrong input");
+
+    index_t ind = 0;
+    size_t left = N_inp;
+    while (left)
+    {
+        size_t n = std::min(left, batch_size);
+        RawBatch batch;
+        batch.first = ind;
+        batch.coords.resize(n * 9);
+        for (auto &coord : batch.coords)
+            if (!(stream >> coord))
+                throw std::runtime_error("Not full input");
+
+        if (!out.push(std::move(batch)))
+            return;
+        ind += n;
+        left -= n;
+    }
+}
+
+// runs transform(batch) for every batch of in and pushes the results to out. After an error the
+// rest of in is drained, so the stages before this one get to the end of the input and find
+// their own errors, which come first in the order of the input
+template <typename In, typename Out, typename F>
+void run_stage(SPSCQueue<In> &in, SPSCQueue<Out> &out, std::exception_ptr &err, F &&transform)
+{
+    In batch;
+    try
+    {
+        while (in.pop(batch))
+            if (!out.push(transform(std::move(batch))))
+                break;
+    }
+    catch (...)
+    {
+        err = std::current_exception();
+    }
+    while (in.pop(batch)) {}
+    out.close();
+}
+
+Shapes classify(RawBatch &&batch)
+{
+    Shapes shapes;
+    size_t n = batch.coords.size() / 9;
+    for (size_t k = 0; k < n; k++)
+        parse_shape(batch.first + k, &batch.coords[9 * k], shapes.points, shapes.linesegs, shapes.triangles);
+    return shapes;
+}
+
+ShapeBatch classify_array(RawBatch &&batch)
+{
+    ShapeBatch out;
+    size_t n = batch.coords.size() / 9;
+    out.inds.reserve(n);
+    out.shapes.reserve(n);
+    for (size_t k = 0; k < n; k++)
+    {
+        const double *c = &batch.coords[9 * k];
+        Geom::Point3D p1{c[0], c[1], c[2]}, p2{c[3], c[4], c[5]}, p3{c[6], c[7], c[8]};
+        out.inds.push_back(batch.first + k);
+        with_shape(p1, p2, p3, [&](const auto &shape) {out.shapes.emplace_back(shape);});
+    }
+    return out;
+}
+
+// boxes of the shapes and bounds of their centers, taken the same way as the LBVH build does
+ShapeBatch insert_boxes(ShapeBatch &&batch)
+{
+    auto &b = batch.center_bounds;
+    batch.boxes.reserve(batch.shapes.size());
+    for (auto &shape : batch.shapes)
+    {
+        Geom::BoundingBox box = std::visit([](const auto &s)
+        {
+            if constexpr (std::is_same_v<std::decay_t<decltype(s)>, Geom::Point3D>)
+                return Geom::BoundingBox{s};
+            else
+                return s.bound_box();
+        }, shape);
+        Geom::Point3D c = box.center();
+        double coords[3] = {c.x(), c.y(), c.z()};
+        for (int axis = 0; axis < 3; axis++)
+        {
+            b[axis]     = std::min(b[axis], coords[axis]);
+            b[axis + 3] = std::max(b[axis + 3], coords[axis]);
+        }
+        batch.boxes.push_back(box);
+    }
+    return std::move(batch);
+}
+
+} // anonymous namespace
+
+void parse_input(std::istream &stream, ListPoint3D &points_out, ListLineSeg3D &linesegs_out,
+                 ListTriangle3D &triangles_out, const Params &params)
+{
+    SPSCQueue<RawBatch> raw{params.queue_capacity};
+    SPSCQueue<Shapes> classified{params.queue_capacity};
+
+    std::exception_ptr read_err, classify_err;
+    std::thread reader([&]()
+    {
+        try { read_stage(stream, std::max<size_t>(params.batch_size, 1), raw); }
+        catch (...) { read_err = std::current_exception(); }
+        raw.close();
+    });
+    std::thread classifier([&]() {run_stage(raw, classified, classify_err, classify);});
+
+    // batches come in the order of the input, so the lists are the same as of parse_input
+    Shapes shapes;
+    while (classified.pop(shapes))
+    {
+        points_out.splice(points_out.end(), shapes.points);
+        linesegs_out.splice(linesegs_out.end(), shapes.linesegs);
+        triangles_out.splice(triangles_out.end(), shapes.triangles);
+    }
+
+    reader.join();
+    classifier.join();
+    if (read_err)
+        std::rethrow_exception(read_err);
+    if (classify_err)
+        std::rethrow_exception(classify_err);
+}
+
+Scene parse_scene(std::istream &stream, const Params &params)
+{
+    SPSCQueue<RawBatch> raw{params.queue_capacity};
+    SPSCQueue<ShapeBatch> classified{params.queue_capacity}, inserted{params.queue_capacity};
+
+    std::exception_ptr read_err, classify_err, insert_err;
+    std::thread reader([&]()
+    {
+        try { read_stage(stream, std::max<size_t>(params.batch_size, 1), raw); }
+        catch (...) { read_err = std::current_exception(); }
+        raw.close();
+    });
+    std::thread classifier([&]() {run_stage(raw, classified, classify_err, classify_array);});
+    std::thread inserter([&]() {run_stage(classified, inserted, insert_err, insert_boxes);});
+
+    Scene scene;
+    scene.center_bounds = ShapeBatch{}.center_bounds;
+    ShapeBatch batch;
+    while (inserted.pop(batch))
+    {
+        scene.inds.insert(scene.inds.end(), batch.inds.begin(), batch.inds.end());
+        scene.shapes.insert(scene.shapes.end(), batch.shapes.begin(), batch.shapes.end());
+        scene.boxes.insert(scene.boxes.end(), batch.boxes.begin(), batch.boxes.end());
+        for (int axis = 0; axis < 3; axis++)
+        {
+            scene.center_bounds[axis]     = std::min(scene.center_bounds[axis], batch.center_bounds[axis]);
+            scene.center_bounds[axis + 3] = std::max(scene.center_bounds[axis + 3], batch.center_bounds[axis + 3]);
+        }
+    }
+
+    reader.join();
+    classifier.join();
+    inserter.join();
+    for (auto &err : {read_err, classify_err, insert_err})
+        if (err)
+            std::rethrow_exception(err);
+    return scene;
+}
+
+} // namespace Pipeline
+
+} // namespace Driver
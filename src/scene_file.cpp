@@ -0,0 +1,324 @@
+#include "scene_file.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Driver
+{
+
+namespace SceneFile
+{
+
+uint64_t checksum(const char *data, size_t size)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+namespace
+{
+
+static_assert(sizeof(index_t) == sizeof(uint64_t), "indices are stored as uint64_t");
+static_assert(std::is_trivially_copyable_v<Shape> && std::is_trivially_copyable_v<Geom::BoundingBox>
+              && std::is_trivially_copyable_v<LBVH::Node> && std::is_trivially_copyable_v<BVH8::Node>,
+              "arrays are stored as they are in memory");
+
+// writes the elements at the next offset aligned to ALIGNMENT, returns this offset
+template <typename T>
+uint64_t write_array(std::ofstream &file, uint64_t &offset, const Storage<T> &arr)
+{
+    static const char zeros[ALIGNMENT] = {};
+    uint64_t aligned = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    file.write(zeros, aligned - offset);
+    file.write(reinterpret_cast<const char *>(arr.data()), arr.size() * sizeof(T));
+    offset = aligned + arr.size() * sizeof(T);
+    return aligned;
+}
+
+void check(bool ok)
+{
+    if (!ok)
+        throw WrongSceneFile("Scene file is corrupted");
+}
+
+// the shapes are in the order of the header and their indices are those of the input
+void check_shapes(const Header &hdr, const ShapeArray &arr)
+{
+    size_t n = arr.size();
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t kind = (i < hdr.n_points) ? 0 : (i < hdr.n_points + hdr.n_linesegs) ? 1 : 2;
+        check(arr.shapes[i].index() == kind && arr.inds[i] < n);
+    }
+}
+
+// the traversals index the arrays and push onto stacks of a fixed size with what they find in the
+// nodes, so the nodes must form a tree over leaves [0, n), every node and leaf reached once from the
+// root, at most MAX_DEPTH levels deep
+void check_tree(const LBVH &bvh)
+{
+    size_t n = bvh.size();
+    for (size_t leaf = 0; leaf < n; leaf++)
+        check(bvh.leaf_item(leaf) < n);
+    if (n <= 1)
+        return;
+
+    auto &nodes = bvh.nodes();
+    std::vector<bool> seen_nodes(nodes.size()), seen_leaves(n);
+    std::vector<std::pair<LBVH::node_t, size_t>> stack{{0, 1}}; // node and its depth
+    while (!stack.empty())
+    {
+        auto [node, depth] = stack.back();
+        stack.pop_back();
+        check(node < nodes.size() && !seen_nodes[node] && depth < LBVH::MAX_DEPTH && nodes[node].last_leaf < n);
+        seen_nodes[node] = true;
+
+        for (LBVH::node_t child : {nodes[node].left, nodes[node].right})
+            if (child & LBVH::LEAF_FLAG)
+            {
+                size_t leaf = child & ~LBVH::LEAF_FLAG;
+                check(leaf < n && !seen_leaves[leaf]);
+                seen_leaves[leaf] = true;
+            }
+            else
+                stack.emplace_back(child, depth + 1);
+    }
+    check(std::find(seen_leaves.begin(), seen_leaves.end(), false) == seen_leaves.end());
+}
+
+// the same for the BVH8, a leaf child is a range of leaves; an empty slot has NaN bounds, so
+// no query takes it for node 0
+void check_tree(const BVH8 &bvh)
+{
+    size_t n = bvh.size();
+    for (size_t leaf = 0; leaf < n; leaf++)
+        check(bvh.leaf_item(leaf) < n);
+    if (n <= 1)
+        return;
+
+    auto &nodes = bvh.nodes();
+    std::vector<bool> seen_nodes(nodes.size()), seen_leaves(n);
+    std::vector<std::pair<uint32_t, size_t>> stack{{0, 1}};
+    while (!stack.empty())
+    {
+        auto [node, depth] = stack.back();
+        stack.pop_back();
+        check(node < nodes.size() && !seen_nodes[node] && depth < BVH8::MAX_DEPTH);
+        seen_nodes[node] = true;
+
+        const BVH8::Node &nd = nodes[node];
+        for (size_t i = 0; i < BVH8::WIDTH; i++)
+        {
+            uint32_t child = nd.child[i];
+            if (!child)
+            {
+                for (int axis = 0; axis < 3; axis++)
+                    check(std::isnan(nd.min[axis][i]) && std::isnan(nd.max[axis][i]));
+                continue;
+            }
+
+            check(nd.last_leaf[i] < n);
+            if (!(child & BVH8::LEAF_FLAG))
+            {
+                stack.emplace_back(child, depth + 1);
+                continue;
+            }
+            size_t first = child & ~BVH8::LEAF_FLAG;
+            check(first <= nd.last_leaf[i]);
+            for (size_t leaf = first; leaf <= nd.last_leaf[i]; leaf++)
+            {
+                check(!seen_leaves[leaf]);
+                seen_leaves[leaf] = true;
+            }
+        }
+    }
+    check(std::find(seen_leaves.begin(), seen_leaves.end(), false) == seen_leaves.end());
+}
+
+} // anonymous namespace
+
+void save(const std::string &filename, uint64_t src_checksum, const ListPoint3D &points,
+          const ListLineSeg3D &linesegs, const ListTriangle3D &triangles)
+{
+    ShapeArray arr = make_shape_array(points, linesegs, triangles);
+    LBVH lbvh{std::vector<Geom::BoundingBox>(arr.boxes.begin(), arr.boxes.end())};
+    BVH8 bvh8{lbvh};
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version        = VERSION;
+    header.header_size    = sizeof(Header);
+    header.src_checksum   = src_checksum;
+    header.shape_size     = sizeof(Shape);
+    header.lbvh_node_size = sizeof(LBVH::Node);
+    header.bvh8_node_size = sizeof(BVH8::Node);
+    header.n_points       = points.size();
+    header.n_linesegs     = linesegs.size();
+    header.n_triangles    = triangles.size();
+    header.n_lbvh_nodes   = lbvh.nodes().size();
+    header.n_bvh8_nodes   = bvh8.nodes().size();
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        throw std::runtime_error("Can't open scene file for writing");
+
+    // the header is written again once the offsets are known
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    uint64_t offset = sizeof(Header);
+    header.inds_offset            = write_array(file, offset, arr.inds);
+    header.shapes_offset          = write_array(file, offset, arr.shapes);
+    header.boxes_offset           = write_array(file, offset, arr.boxes);
+    header.lbvh_nodes_offset      = write_array(file, offset, lbvh.nodes());
+    header.lbvh_leaf_boxes_offset = write_array(file, offset, lbvh.leaf_boxes());
+    header.lbvh_leaf_items_offset = write_array(file, offset, lbvh.leaf_items());
+    header.bvh8_nodes_offset      = write_array(file, offset, bvh8.nodes());
+    header.bvh8_leaf_boxes_offset = write_array(file, offset, bvh8.leaf_boxes());
+    header.bvh8_leaf_items_offset = write_array(file, offset, bvh8.leaf_items());
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    if (!file)
+        throw std::runtime_error("Can't write scene file");
+}
+
+Mapped::Mapped(const std::string &filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw WrongSceneFile("Can't open scene file");
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+    {
+        close(fd);
+        throw WrongSceneFile("Scene file is too small");
+    }
+    size_ = st.st_size;
+
+    void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        throw WrongSceneFile("Can't mmap scene file");
+    data_ = static_cast<const char *>(addr);
+
+    try
+    {
+        const Header &hdr = header();
+        if (std::memcmp(hdr.magic, MAGIC, sizeof(MAGIC)) != 0)
+            throw WrongSceneFile("Not a scene file");
+        if (hdr.version != VERSION || hdr.header_size != sizeof(Header))
+            throw WrongSceneFile("Unsupported scene file version");
+        if (hdr.shape_size != sizeof(Shape) || hdr.lbvh_node_size != sizeof(LBVH::Node)
+            || hdr.bvh8_node_size != sizeof(BVH8::Node))
+            throw WrongSceneFile("Scene file is saved by a build with another layout");
+
+        // leaves are numbered below LEAF_FLAG; an LBVH of n leaves has n - 1 internal nodes, a BVH8
+        // has some unless there is one leaf
+        uint64_t n = hdr.n_shapes();
+        if (hdr.n_points >= LBVH::LEAF_FLAG || hdr.n_linesegs >= LBVH::LEAF_FLAG || hdr.n_triangles >= LBVH::LEAF_FLAG
+            || n >= LBVH::LEAF_FLAG || hdr.n_lbvh_nodes != (n > 1 ? n - 1 : 0) || (hdr.n_bvh8_nodes == 0) != (n <= 1))
+            throw WrongSceneFile("Scene file is corrupted");
+
+        // checks that all of the arrays are inside the file and hold what the queries expect
+        check_shapes(hdr, shapes());
+        check_tree(lbvh());
+        check_tree(bvh8());
+    }
+    catch (...)
+    {
+        munmap(const_cast<char *>(data_), size_);
+        throw;
+    }
+}
+
+Mapped::~Mapped()
+{
+    munmap(const_cast<char *>(data_), size_);
+}
+
+template <typename T>
+const T *Mapped::array(uint64_t offset, uint64_t n) const
+{
+    if (offset % alignof(T) != 0 || offset > size_ || n > (size_ - offset) / sizeof(T))
+        throw WrongSceneFile("Scene file is corrupted");
+    return reinterpret_cast<const T *>(data_ + offset);
+}
+
+ShapeArray Mapped::shapes() const
+{
+    const Header &hdr = header();
+    size_t n = hdr.n_shapes();
+    return ShapeArray{Storage<index_t>{array<index_t>(hdr.inds_offset, n), n},
+                      Storage<Shape>{array<Shape>(hdr.shapes_offset, n), n},
+                      Storage<Geom::BoundingBox>{array<Geom::BoundingBox>(hdr.boxes_offset, n), n}};
+}
+
+LBVH Mapped::lbvh() const
+{
+    const Header &hdr = header();
+    size_t n = hdr.n_shapes();
+    return LBVH{Storage<LBVH::Node>{array<LBVH::Node>(hdr.lbvh_nodes_offset, hdr.n_lbvh_nodes), hdr.n_lbvh_nodes},
+                Storage<Geom::BoundingBox>{array<Geom::BoundingBox>(hdr.lbvh_leaf_boxes_offset, n), n},
+                Storage<uint32_t>{array<uint32_t>(hdr.lbvh_leaf_items_offset, n), n}};
+}
+
+BVH8 Mapped::bvh8() const
+{
+    const Header &hdr = header();
+    size_t n = hdr.n_shapes();
+    return BVH8{Storage<BVH8::Node>{array<BVH8::Node>(hdr.bvh8_nodes_offset, hdr.n_bvh8_nodes), hdr.n_bvh8_nodes},
+                Storage<Geom::BoundingBox>{array<Geom::BoundingBox>(hdr.bvh8_leaf_boxes_offset, n), n},
+                Storage<uint32_t>{array<uint32_t>(hdr.bvh8_leaf_items_offset, n), n}};
+}
+
+void Mapped::load(ListPoint3D &points_out, ListLineSeg3D &linesegs_out, ListTriangle3D &triangles_out) const
+{
+    ShapeArray arr = shapes();
+    for (size_t i = 0; i < arr.size(); i++)
+        std::visit([&](const auto &shape)
+        {
+            using S = std::decay_t<decltype(shape)>;
+            if constexpr (std::is_same_v<S, Geom::Point3D>)
+                points_out.push_back(std::make_pair(arr.inds[i], shape));
+            else if constexpr (std::is_same_v<S, Geom::LineSeg3D>)
+                linesegs_out.push_back(std::make_pair(arr.inds[i], shape));
+            else
+                triangles_out.push_back(std::make_pair(arr.inds[i], shape));
+        }, arr.shapes[i]);
+}
+
+bool Mapped::has_tree(Engine engine)
+{
+    return engine == Engine::LBVH || engine == Engine::BVH8 || engine == Engine::Auto;
+}
+
+std::set<index_t> Mapped::get_inds_with_intscs(Engine engine, Stats *stats, UnionFind *components) const
+{
+    switch (engine)
+    {
+    case Engine::LBVH: return get_inds_with_intscs_lbvh(shapes(), lbvh(), stats, components);
+    case Engine::BVH8:
+    case Engine::Auto: return get_inds_with_intscs_bvh8(shapes(), bvh8(), stats, components);
+    default:           throw std::runtime_error("Scene file has no tree of the engine");
+    }
+}
+
+} // namespace SceneFile
+
+} // namespace Driver
@@ -0,0 +1,590 @@
+#include "server.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <sstream>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace Driver
+{
+
+namespace Server
+{
+
+namespace
+{
+
+const size_t GRAIN = 64;
+// the LBVH is rebuilt when there are more edits since the last rebuild than
+// max(REBUILD_MIN, 1 / REBUILD_RATIO of the shapes in it)
+const size_t REBUILD_MIN = 64;
+const size_t REBUILD_RATIO = 16;
+// requests are short, a longer line is an error
+const size_t MAX_REQUEST = 1 << 16;
+
+Geom::BoundingBox box_of(const Shape &shape)
+{
+    return std::visit([](const auto &s)
+    {
+        if constexpr (std::is_same_v<std::decay_t<decltype(s)>, Geom::Point3D>)
+            return Geom::BoundingBox{s};
+        else
+            return s.bound_box();
+    }, shape);
+}
+
+// drops the derived data of a shape, Point3D is stored as is
+template <typename StoredShape>
+StoredShape compact(const Shape &shape)
+{
+    return std::visit([](const auto &s)
+    {
+        using S = std::decay_t<decltype(s)>;
+        if constexpr (std::is_same_v<S, Geom::Point3D>)
+            return StoredShape{s};
+        else if constexpr (std::is_same_v<S, Geom::LineSeg3D>)
+            return StoredShape{Geom::CompactLineSeg3D<double>{s}};
+        else
+            return StoredShape{Geom::CompactTriangle3D<double>{s}};
+    }, shape);
+}
+
+std::runtime_error system_error(const std::string &what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+} // anonymous namespace
+
+Scene::Scene(const ListPoint3D &points, const ListLineSeg3D &linesegs, const ListTriangle3D &triangles)
+{
+    ShapeArray arr = make_shape_array(points, linesegs, triangles);
+    size_t n = 0;
+    for (auto ind : arr.inds)
+        n = std::max(n, ind + 1);
+
+    shapes_.resize(n, Geom::Point3D{0, 0, 0});
+    boxes_.resize(n, Geom::BoundingBox{Geom::Point3D{0, 0, 0}});
+    present_.resize(n);
+    for (size_t i = 0; i < arr.size(); i++)
+    {
+        shapes_[arr.inds[i]] = compact<StoredShape>(arr.shapes[i]);
+        boxes_[arr.inds[i]] = arr.boxes[i];
+        present_[arr.inds[i]] = true;
+    }
+    n_present_ = arr.size();
+    rebuild();
+}
+
+Shape Scene::shape(index_t ind) const
+{
+    return std::visit([](const auto &s)
+    {
+        if constexpr (std::is_same_v<std::decay_t<decltype(s)>, Geom::Point3D>)
+            return Shape{s};
+        else
+            return Shape{s.full()};
+    }, shapes_[ind]);
+}
+
+void Scene::rebuild()
+{
+    indexed_.clear();
+    std::vector<Geom::BoundingBox> boxes;
+    for (index_t ind = 0; ind < shapes_.size(); ind++)
+        if (present_[ind])
+        {
+            indexed_.push_back(ind);
+            boxes.push_back(boxes_[ind]);
+        }
+
+    bvh_.reset();
+    if (!boxes.empty())
+        bvh_.emplace(boxes);
+    added_.clear();
+    n_removed_ = 0;
+}
+
+void Scene::rebuild_if_needed()
+{
+    if (added_.size() + n_removed_ > std::max(REBUILD_MIN, indexed_.size() / REBUILD_RATIO))
+        rebuild();
+}
+
+template <typename F>
+void Scene::for_candidates(const Geom::BoundingBox &box, F &&on_shape) const
+{
+    if (bvh_)
+        bvh_->query(box, [&](size_t leaf)
+        {
+            index_t ind = indexed_[bvh_->leaf_item(leaf)];
+            if (present_[ind])
+                on_shape(ind);
+        });
+
+    for (auto ind : added_)
+        if (present_[ind] && boxes_[ind].intersects(box))
+            on_shape(ind);
+}
+
+std::vector<index_t> Scene::intersections() const
+{
+    std::shared_lock<std::shared_mutex> scene_lock{mutex_};
+    // concurrent requests wait for the first one to fill the cache
+    std::lock_guard<std::mutex> cache_lock{cache_mutex_};
+    if (all_)
+        return *all_;
+
+    std::vector<std::atomic<bool>> found(shapes_.size());
+    std::vector<Stats> thread_stats(Parallel::n_threads());
+    // the full shape of a is built at the first candidate, most shapes have none
+    auto test = [&](size_t thr, std::optional<Shape> &shape, index_t a, index_t b)
+    {
+        if (!shape)
+            shape = this->shape(a);
+        if (intersects(*shape, this->shape(b), thread_stats[thr]))
+        {
+            found[a].store(true, std::memory_order_relaxed);
+            found[b].store(true, std::memory_order_relaxed);
+        }
+    };
+
+    // pairs inside the LBVH, every pair once
+    auto test_leaf = [&](size_t thr, size_t leaf)
+    {
+        index_t ind = indexed_[bvh_->leaf_item(leaf)];
+        if (!present_[ind])
+            return;
+        std::optional<Shape> shape;
+        bvh_->query(bvh_->leaf_box(leaf), [&](size_t other_leaf)
+        {
+            index_t other = indexed_[bvh_->leaf_item(other_leaf)];
+            if (other_leaf != leaf && present_[other])
+                test(thr, shape, ind, other);
+        }, leaf);
+    };
+
+    // added shapes with the LBVH and with the added shapes after them; they come in no spatial
+    // order, so a block of them is queried with interleaved traversals
+    auto test_added = [&](size_t thr, size_t begin, size_t end)
+    {
+        std::vector<std::optional<Shape>> shapes(end - begin);
+        if (bvh_)
+            bvh_->query_interleaved(end - begin, [&](size_t k) -> const Geom::BoundingBox &
+            {
+                return boxes_[added_[begin + k]];
+            },
+            [&](size_t k, size_t leaf)
+            {
+                index_t ind = added_[begin + k], other = indexed_[bvh_->leaf_item(leaf)];
+                if (present_[ind] && present_[other])
+                    test(thr, shapes[k], ind, other);
+            });
+
+        for (size_t k = begin; k < end; k++)
+        {
+            index_t ind = added_[k];
+            if (!present_[ind])
+                continue;
+            for (size_t l = k + 1; l < added_.size(); l++)
+                if (present_[added_[l]] && boxes_[ind].intersects(boxes_[added_[l]]))
+                    test(thr, shapes[k - begin], ind, added_[l]);
+        }
+    };
+
+    // both parts in one parallel loop over blocks of GRAIN leaves and then of GRAIN added shapes;
+    // ALL requests compute one at a time under cache_mutex_, so the server never runs more than
+    // n_threads() workers however many clients ask
+    size_t n_leaves = bvh_ ? bvh_->size() : 0;
+    size_t n_leaf_blocks = (n_leaves + GRAIN - 1) / GRAIN, n_added_blocks = (added_.size() + GRAIN - 1) / GRAIN;
+    Parallel::for_each(n_leaf_blocks + n_added_blocks, 1, [&](size_t thr, size_t block)
+    {
+        if (block < n_leaf_blocks)
+        {
+            for (size_t leaf = block * GRAIN; leaf < std::min(n_leaves, (block + 1) * GRAIN); leaf++)
+                test_leaf(thr, leaf);
+            return;
+        }
+        size_t begin = (block - n_leaf_blocks) * GRAIN;
+        test_added(thr, begin, std::min(added_.size(), begin + GRAIN));
+    });
+
+    std::vector<index_t> inds;
+    for (index_t ind = 0; ind < found.size(); ind++)
+        if (found[ind].load(std::memory_order_relaxed))
+            inds.push_back(ind);
+    all_ = inds;
+    return inds;
+}
+
+std::vector<index_t> Scene::intersecting(const Shape &shape) const
+{
+    Stats stats;
+    std::vector<index_t> inds;
+    for_candidates(box_of(shape), [&](index_t ind)
+    {
+        if (intersects(shape, this->shape(ind), stats))
+            inds.push_back(ind);
+    });
+    return inds;
+}
+
+std::vector<index_t> Scene::query(const Shape &shape) const
+{
+    std::shared_lock<std::shared_mutex> lock{mutex_};
+    std::vector<index_t> inds = intersecting(shape);
+    std::sort(inds.begin(), inds.end());
+    return inds;
+}
+
+index_t Scene::add(const Shape &shape)
+{
+    std::unique_lock<std::shared_mutex> lock{mutex_};
+    index_t ind = shapes_.size();
+    shapes_.push_back(compact<StoredShape>(shape));
+    boxes_.push_back(box_of(shape));
+    present_.push_back(true);
+    n_present_++;
+    added_.push_back(ind);
+
+    std::lock_guard<std::mutex> cache_lock{cache_mutex_};
+    if (all_)
+    {
+        // the new shape and everything else it intersects; if a test fails (e.g. on a NaN), the
+        // cache is dropped and the next ALL reports the error, as it would without the cache
+        try
+        {
+            std::vector<index_t> hits = intersecting(shape);
+            hits.erase(std::remove(hits.begin(), hits.end(), ind), hits.end());
+            if (!hits.empty())
+            {
+                hits.push_back(ind);
+                std::sort(hits.begin(), hits.end());
+                std::vector<index_t> merged;
+                std::set_union(all_->begin(), all_->end(), hits.begin(), hits.end(), std::back_inserter(merged));
+                all_ = std::move(merged);
+            }
+        }
+        catch (...)
+        {
+            all_.reset();
+        }
+    }
+
+    rebuild_if_needed();
+    return ind;
+}
+
+void Scene::remove(index_t ind)
+{
+    std::unique_lock<std::shared_mutex> lock{mutex_};
+    if (ind >= shapes_.size() || !present_[ind])
+        throw WrongRequest("No shape " + std::to_string(ind));
+    present_[ind] = false;
+    n_present_--;
+
+    auto it = std::find(added_.begin(), added_.end(), ind);
+    if (it != added_.end())
+        added_.erase(it);
+    else
+        n_removed_++;
+
+    std::lock_guard<std::mutex> cache_lock{cache_mutex_};
+    if (all_)
+    {
+        // neighbours of the removed shape stay only if they intersect something else; a failed
+        // test drops the cache, as in add
+        try
+        {
+            std::vector<index_t> gone{ind};
+            for (auto other : intersecting(shape(ind)))
+            {
+                std::vector<index_t> hits = intersecting(shape(other));
+                if (std::all_of(hits.begin(), hits.end(), [other](index_t hit) {return hit == other;}))
+                    gone.push_back(other);
+            }
+            std::sort(gone.begin(), gone.end());
+            std::vector<index_t> rest;
+            std::set_difference(all_->begin(), all_->end(), gone.begin(), gone.end(), std::back_inserter(rest));
+            all_ = std::move(rest);
+        }
+        catch (...)
+        {
+            all_.reset();
+        }
+    }
+
+    rebuild_if_needed();
+}
+
+size_t Scene::size() const
+{
+    std::shared_lock<std::shared_mutex> lock{mutex_};
+    return n_present_;
+}
+
+namespace
+{
+
+enum class Action {Continue, Quit, Shutdown};
+
+Shape read_shape(std::istream &stream)
+{
+    double c[9];
+    for (auto &coord : c)
+        if (!(stream >> coord))
+            throw WrongRequest("Expected 9 coordinates");
+    return with_shape(Geom::Point3D{c[0], c[1], c[2]}, Geom::Point3D{c[3], c[4], c[5]},
+                      Geom::Point3D{c[6], c[7], c[8]}, [](const auto &shape) {return Shape{shape};});
+}
+
+void expect_end(std::istream &stream)
+{
+    std::string extra;
+    if (stream >> extra)
+        throw WrongRequest("Unexpected " + extra);
+}
+
+std::string ok(const std::vector<index_t> &values)
+{
+    std::string response = "OK";
+    for (auto value : values)
+        response += ' ' + std::to_string(value);
+    return response;
+}
+
+std::string respond(Scene &scene, const std::string &request, Action &action)
+{
+    std::istringstream stream{request};
+    std::string command;
+    stream >> command;
+
+    if (command == "ALL")
+    {
+        expect_end(stream);
+        return ok(scene.intersections());
+    }
+    if (command == "QUERY")
+    {
+        Shape shape = read_shape(stream);
+        expect_end(stream);
+        return ok(scene.query(shape));
+    }
+    if (command == "ADD")
+    {
+        Shape shape = read_shape(stream);
+        expect_end(stream);
+        return ok({scene.add(shape)});
+    }
+    if (command == "REMOVE")
+    {
+        index_t ind = 0;
+        if (!(stream >> ind))
+            throw WrongRequest("Expected an index");
+        expect_end(stream);
+        scene.remove(ind);
+        return ok({});
+    }
+    if (command == "SIZE")
+    {
+        expect_end(stream);
+        return ok({scene.size()});
+    }
+    if (command == "QUIT" || command == "SHUTDOWN")
+    {
+        expect_end(stream);
+        action = (command == "QUIT") ? Action::Quit : Action::Shutdown;
+        return ok({});
+    }
+    throw WrongRequest("Unknown request " + command);
+}
+
+bool write_all(int fd, const std::string &data)
+{
+    size_t written = 0;
+    while (written < data.size())
+    {
+        // the client may be gone, that must not kill the server with SIGPIPE
+        ssize_t cnt = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (cnt < 0 && errno == EINTR)
+            continue;
+        if (cnt <= 0)
+            return false;
+        written += cnt;
+    }
+    return true;
+}
+
+void serve_client(Scene &scene, int fd, const std::function<void()> &shutdown)
+{
+    std::string buffer;
+    char chunk[4096];
+    while (true)
+    {
+        size_t eol = buffer.find('\n');
+        if (eol == std::string::npos)
+        {
+            if (buffer.size() > MAX_REQUEST)
+            {
+                write_all(fd, "ERR Request is too long\n");
+                return;
+            }
+            ssize_t cnt = recv(fd, chunk, sizeof(chunk), 0);
+            if (cnt < 0 && errno == EINTR)
+                continue;
+            if (cnt <= 0)
+                return;
+            buffer.append(chunk, cnt);
+            continue;
+        }
+
+        std::string request = buffer.substr(0, eol);
+        buffer.erase(0, eol + 1);
+        if (!request.empty() && request.back() == '\r')
+            request.pop_back();
+
+        Action action = Action::Continue;
+        std::string response;
+        try
+        {
+            response = respond(scene, request, action);
+        }
+        catch (const std::exception &e)
+        {
+            response = std::string("ERR ") + e.what();
+        }
+
+        if (!write_all(fd, response + '\n'))
+            return;
+        if (action == Action::Shutdown)
+            shutdown();
+        if (action != Action::Continue)
+            return;
+    }
+}
+
+struct Client
+{
+    int fd = -1;
+    std::thread thread;
+    std::atomic<bool> done{false};
+};
+
+} // anonymous namespace
+
+void serve(Scene &scene, const std::string &socket_path)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Socket path is too long: " + socket_path);
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    struct stat st{};
+    if (lstat(socket_path.c_str(), &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+            throw std::runtime_error(socket_path + " exists and is not a socket");
+        unlink(socket_path.c_str());
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+        throw system_error("Can't create socket");
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0
+        || listen(listen_fd, SOMAXCONN) < 0)
+    {
+        std::runtime_error err = system_error("Can't listen on " + socket_path);
+        close(listen_fd);
+        throw err;
+    }
+
+    // shutting the sockets down wakes accept() and the clients waiting for requests
+    std::mutex clients_mutex;
+    std::list<Client> clients;
+    bool stopping = false;
+    auto shutdown = [&]()
+    {
+        std::lock_guard<std::mutex> lock{clients_mutex};
+        if (stopping)
+            return;
+        stopping = true;
+        ::shutdown(listen_fd, SHUT_RDWR);
+        for (auto &client : clients)
+            ::shutdown(client.fd, SHUT_RDWR);
+    };
+
+    int accept_errno = 0;
+    while (true)
+    {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+
+        std::lock_guard<std::mutex> lock{clients_mutex};
+        if (stopping)
+        {
+            if (fd >= 0)
+                close(fd);
+            break;
+        }
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            accept_errno = errno;
+            break;
+        }
+
+        // finished clients are joined here, so they don't pile up on a long-running server
+        for (auto it = clients.begin(); it != clients.end();)
+        {
+            if (!it->done.load(std::memory_order_acquire))
+            {
+                it++;
+                continue;
+            }
+            it->thread.join();
+            close(it->fd);
+            it = clients.erase(it);
+        }
+
+        Client &client = clients.emplace_back();
+        client.fd = fd;
+        client.thread = std::thread([&scene, &shutdown, &client]()
+        {
+            serve_client(scene, client.fd, shutdown);
+            client.done.store(true, std::memory_order_release);
+        });
+    }
+
+    if (accept_errno)
+        shutdown();
+    // no one touches the list after stopping
+    for (auto &client : clients)
+    {
+        client.thread.join();
+        close(client.fd);
+    }
+    close(listen_fd);
+    unlink(socket_path.c_str());
+
+    if (accept_errno)
+    {
+        errno = accept_errno;
+        throw system_error("Can't accept a connection");
+    }
+}
+
+} // namespace Server
+
+} // namespace Driver
@@ -0,0 +1,172 @@
+#include "tiled.hpp"
+#include "parallel.hpp"
+#include "union_find.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace Driver
+{
+
+namespace
+{
+
+// 256 boxes of a block take 12K, the two blocks of a tile fit into L1 together; a multiple of 64
+const size_t BLOCK = 256;
+
+// boxes as separate coordinate arrays, so that the loop over a block is vectorized
+struct BoxColumns
+{
+    std::vector<double> min[3], max[3];
+
+    explicit BoxColumns(const Storage<Geom::BoundingBox> &boxes)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            min[axis].resize(boxes.size());
+            max[axis].resize(boxes.size());
+        }
+        for (size_t i = 0; i < boxes.size(); i++)
+        {
+            Geom::Point3D lo = boxes[i].min(), hi = boxes[i].max();
+            min[0][i] = lo.x(); min[1][i] = lo.y(); min[2][i] = lo.z();
+            max[0][i] = hi.x(); max[1][i] = hi.y(); max[2][i] = hi.z();
+        }
+    }
+};
+
+// bit k of masks[k / 64] is set if box i of a intersects box begin + k of b, for begin + k < end.
+// It is the same test as BoundingBox::intersects, as Geom::leq(x, y) is x - y < DBL_PRECISION: the
+// largest gap along the axes must be below DBL_PRECISION (coordinates are never NaN). Two boxes of b
+// are tested at once with SSE2, which every x86-64 has
+void overlap_masks(const BoxColumns &a, size_t i, const BoxColumns &b, size_t begin, size_t end, uint64_t *masks)
+{
+    const double *b_min_x = b.min[0].data(), *b_min_y = b.min[1].data(), *b_min_z = b.min[2].data();
+    const double *b_max_x = b.max[0].data(), *b_max_y = b.max[1].data(), *b_max_z = b.max[2].data();
+    size_t n = end - begin, k = 0;
+    std::fill(masks, masks + (n + 63) / 64, 0);
+
+#ifdef __SSE2__
+    __m128d eps = _mm_set1_pd(Geom::DBL_PRECISION);
+    __m128d min_x = _mm_set1_pd(a.min[0][i]), min_y = _mm_set1_pd(a.min[1][i]), min_z = _mm_set1_pd(a.min[2][i]);
+    __m128d max_x = _mm_set1_pd(a.max[0][i]), max_y = _mm_set1_pd(a.max[1][i]), max_z = _mm_set1_pd(a.max[2][i]);
+    for (; k + 2 <= n; k += 2)
+    {
+        size_t j = begin + k;
+        __m128d gap_x = _mm_max_pd(_mm_sub_pd(min_x, _mm_loadu_pd(b_max_x + j)), _mm_sub_pd(_mm_loadu_pd(b_min_x + j), max_x));
+        __m128d gap_y = _mm_max_pd(_mm_sub_pd(min_y, _mm_loadu_pd(b_max_y + j)), _mm_sub_pd(_mm_loadu_pd(b_min_y + j), max_y));
+        __m128d gap_z = _mm_max_pd(_mm_sub_pd(min_z, _mm_loadu_pd(b_max_z + j)), _mm_sub_pd(_mm_loadu_pd(b_min_z + j), max_z));
+        __m128d gap = _mm_max_pd(_mm_max_pd(gap_x, gap_y), gap_z);
+        uint64_t bits = _mm_movemask_pd(_mm_cmplt_pd(gap, eps));
+        masks[k / 64] |= bits << (k % 64);
+    }
+#endif
+
+    for (; k < n; k++)
+    {
+        size_t j = begin + k;
+        double gap = std::max({a.min[0][i] - b_max_x[j], b_min_x[j] - a.max[0][i],
+                               a.min[1][i] - b_max_y[j], b_min_y[j] - a.max[1][i],
+                               a.min[2][i] - b_max_z[j], b_min_z[j] - a.max[2][i]});
+        masks[k / 64] |= uint64_t{gap < Geom::DBL_PRECISION} << (k % 64);
+    }
+}
+
+// calls on_pair(i, j) for every intersecting pair of a[i] and b[j]; with self a and b
+// are the same array and only pairs with i < j are tested
+template <typename F>
+void for_intersecting_pairs_tiled(const ShapeArray &a, const BoxColumns &cols_a, const ShapeArray &b,
+                                  const BoxColumns &cols_b, bool self, std::vector<Stats> &thread_stats,
+                                  F &&on_pair)
+{
+    size_t blocks_a = (a.size() + BLOCK - 1) / BLOCK, blocks_b = (b.size() + BLOCK - 1) / BLOCK;
+    std::vector<std::pair<uint32_t, uint32_t>> tiles;
+    for (size_t block_a = 0; block_a < blocks_a; block_a++)
+        for (size_t block_b = self ? block_a : 0; block_b < blocks_b; block_b++)
+            tiles.emplace_back(block_a, block_b);
+
+    Parallel::for_each(tiles.size(), 1, [&](size_t thr, size_t tile)
+    {
+        auto [block_a, block_b] = tiles[tile];
+        uint64_t masks[BLOCK / 64];
+        size_t end_a = std::min(a.size(), (block_a + 1) * BLOCK), end_b = std::min(b.size(), (block_b + 1) * BLOCK);
+        for (size_t i = block_a * BLOCK; i < end_a; i++)
+        {
+            size_t begin = (self && block_a == block_b) ? i + 1 : block_b * BLOCK;
+            overlap_masks(cols_a, i, cols_b, begin, end_b, masks);
+            for (size_t word = 0; word * 64 < end_b - begin; word++)
+                for (uint64_t bits = masks[word]; bits; bits &= bits - 1)
+                {
+                    size_t j = begin + word * 64 + __builtin_ctzll(bits);
+                    if (intersects(a.shapes[i], b.shapes[j], thread_stats[thr]))
+                        on_pair(i, j);
+                }
+        }
+    });
+}
+
+} // anonymous namespace
+
+std::set<index_t> get_inds_with_intscs_tiled(const ShapeArray &arr, Stats *stats, UnionFind *components)
+{
+    BoxColumns cols{arr.boxes};
+    std::vector<std::atomic<bool>> found(arr.size());
+    std::vector<Stats> thread_stats(Parallel::n_threads());
+
+    for_intersecting_pairs_tiled(arr, cols, arr, cols, true, thread_stats, [&](size_t i, size_t j)
+    {
+        found[i].store(true, std::memory_order_relaxed);
+        found[j].store(true, std::memory_order_relaxed);
+        if (components)
+            components->unite(arr.inds[i], arr.inds[j]);
+    });
+
+    std::set<index_t> indcs;
+    for (size_t i = 0; i < arr.size(); i++)
+        if (found[i].load(std::memory_order_relaxed))
+            indcs.insert(arr.inds[i]);
+
+    if (stats)
+    {
+        *stats = Stats{};
+        for (auto &st : thread_stats)
+            *stats += st;
+    }
+    return indcs;
+}
+
+void get_inds_with_cross_intscs_tiled(const ShapeArray &arr_a, const ShapeArray &arr_b, std::set<index_t> &inds_a,
+                                      std::set<index_t> &inds_b, Stats *stats, UnionFind *components)
+{
+    BoxColumns cols_a{arr_a.boxes}, cols_b{arr_b.boxes};
+    std::vector<std::atomic<bool>> found_a(arr_a.size()), found_b(arr_b.size());
+    std::vector<Stats> thread_stats(Parallel::n_threads());
+
+    for_intersecting_pairs_tiled(arr_a, cols_a, arr_b, cols_b, false, thread_stats, [&](size_t i, size_t j)
+    {
+        found_a[i].store(true, std::memory_order_relaxed);
+        found_b[j].store(true, std::memory_order_relaxed);
+        if (components)
+            components->unite(arr_a.inds[i], arr_b.inds[j]);
+    });
+
+    for (size_t i = 0; i < arr_a.size(); i++)
+        if (found_a[i].load(std::memory_order_relaxed))
+            inds_a.insert(arr_a.inds[i]);
+    for (size_t j = 0; j < arr_b.size(); j++)
+        if (found_b[j].load(std::memory_order_relaxed))
+            inds_b.insert(arr_b.inds[j]);
+
+    if (stats)
+    {
+        *stats = Stats{};
+        for (auto &st : thread_stats)
+            *stats += st;
+    }
+}
+
+} // namespace Driver
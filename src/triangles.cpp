@@ -3,6 +3,7 @@
 #include <cmath>
 #include <cassert>
 #include <tuple>
+#include <algorithm>
 
 namespace Geom
 {
@@ -69,7 +70,7 @@ Vector3D::operator Point3D() const
 Vector3D Vector3D::norm_vec() const
 {
     scalar_t len = sqrt(x_*x_ + y_*y_ + z_*z_);
-    if (is_zero())
+    if (eq(len, 0))
         return Vector3D{0, 0, 0};
     return Vector3D{x_/len, y_/len, z_/len};
 }
@@ -172,16 +173,6 @@ bool Plane::is_parallel_to(const Plane &rhs) const
     return (n_vec_ == rhs.n_vec_ || n_vec_ == -rhs.n_vec_);
 }
 
-Vector3D Plane::n_vec() const
-{
-    return n_vec_;
-}
-
-Point3D Plane::p() const
-{
-    return p_;
-}
-
 bool Plane::has_point(Point3D q) const
 {
     return eq(dot_prod(Vector3D{p_, q}, n_vec_), 0);
@@ -216,16 +207,6 @@ bool Line3D::is_parallel_to(const Line3D &rhs) const
     return dir_ == rhs.dir_ || dir_ == -rhs.dir_;
 }
 
-Vector3D Line3D::dir() const
-{
-    return dir_;
-}
-
-Point3D Line3D::p() const
-{
-    return p_;
-}
-
 bool Line3D::has_point(Point3D q) const
 {
     return cross_prod(dir_, Vector3D{q} + -Vector3D{p_}).is_zero();
@@ -245,26 +226,6 @@ LineSeg3D::LineSeg3D(Point3D p, Vector3D v) :
         throw DegeneratedLineSeg();
 }
 
-Point3D LineSeg3D::p1() const
-{
-    return p1_;
-}
-
-Point3D LineSeg3D::p2() const
-{
-    return p2_;
-}
-
-Vector3D LineSeg3D::vec() const
-{
-    return vec_;
-}
-
-BoundingBox LineSeg3D::bound_box() const
-{
-    return bound_box_;
-}
-
 bool LineSeg3D::has_point(Point3D q) const
 {
     Vector3D dir{p1_, q};
@@ -289,43 +250,30 @@ bool LineSeg3D::intersects_LineSeg3D(const LineSeg3D &ls) const
     Vector3D norm_other_ls_vec = ls.vec_.norm_vec();
     Vector3D b = -a + dot_prod(a, norm_ls_vec) * norm_ls_vec;
     scalar_t b_len = b.len();
-    Point3D p_intsc = ls.p1_ + norm_other_ls_vec * ((b_len * b_len) / dot_prod(b, norm_other_ls_vec));
-
-    return has_point(p_intsc);
-}
-
-Triangle3D::Triangle3D(Point3D p1, Point3D p2, Point3D p3) : 
-    p1_(p1), p2_(p2), p3_(p3), plane_(Vector3D{1,0,0}, Point3D{0,0,0}), bound_box_({p1, p2, p3})
-{
-    if (p1_ == p2_ || p2_ == p3_ || p1_ == p3_)
-        throw DegeneratedTriangle();
+    if (eq(b_len, 0)) // lines cross at ls.p1_, which is checked above
+        return false;
 
-    plane_ = Plane{cross_prod({p1_, p2_}, {p1_, p3_}), p1_};
-}
+    Point3D p_intsc = ls.p1_ + norm_other_ls_vec * ((b_len * b_len) / dot_prod(b, norm_other_ls_vec));
 
-Point3D Triangle3D::p1() const
-{
-    return p1_;
+    return has_point(p_intsc) && ls.has_point(p_intsc);
 }
 
-Point3D Triangle3D::p2() const
+namespace
 {
-    return p2_;
-}
 
-Point3D Triangle3D::p3() const
+// vertices are checked before the plane is built, so coinciding ones give DegeneratedTriangle
+Plane triangle_plane(const Point3D &p1, const Point3D &p2, const Point3D &p3)
 {
-    return p3_;
+    if (p1 == p2 || p2 == p3 || p1 == p3)
+        throw Triangle3D::DegeneratedTriangle();
+    return Plane{cross_prod({p1, p2}, {p1, p3}), p1};
 }
 
-Plane Triangle3D::plane() const
-{
-    return plane_;
-}
+} // anonymous namespace
 
-BoundingBox Triangle3D::bound_box() const
+Triangle3D::Triangle3D(Point3D p1, Point3D p2, Point3D p3) : 
+    p1_(p1), p2_(p2), p3_(p3), plane_(triangle_plane(p1, p2, p3)), bound_box_({p1, p2, p3})
 {
-    return bound_box_;
 }
 
 bool Triangle3D::has_point(const Point3D &p) const
@@ -556,6 +504,72 @@ BoundingBox::BoundingBox(std::initializer_list<Point3D> points):
     }
 }
 
+Point3D BoundingBox::center() const
+{
+    return Point3D{(min_x_ + max_x_) / 2, (min_y_ + max_y_) / 2, (min_z_ + max_z_) / 2};
+}
+
+BoundingBox &BoundingBox::expand(const BoundingBox &other)
+{
+    min_x_ = std::min(min_x_, other.min_x_);
+    min_y_ = std::min(min_y_, other.min_y_);
+    min_z_ = std::min(min_z_, other.min_z_);
+    max_x_ = std::max(max_x_, other.max_x_);
+    max_y_ = std::max(max_y_, other.max_y_);
+    max_z_ = std::max(max_z_, other.max_z_);
+    return *this;
+}
+
+bool Triangle3D::intersects_BoundingBox(const BoundingBox &box, scalar_t margin) const
+{
+    Point3D c = box.center();
+    Point3D box_max = box.max();
+    scalar_t h[3] = {box_max.x() - c.x() + margin, box_max.y() - c.y() + margin, box_max.z() - c.z() + margin};
+
+    // vertices relative to the center of the box
+    scalar_t v[3][3] = {{p1_.x() - c.x(), p1_.y() - c.y(), p1_.z() - c.z()},
+                        {p2_.x() - c.x(), p2_.y() - c.y(), p2_.z() - c.z()},
+                        {p3_.x() - c.x(), p3_.y() - c.y(), p3_.z() - c.z()}};
+
+    // true if the projections of the triangle and of the box on the axis don't overlap
+    auto separates = [&](const scalar_t a[3])
+    {
+        scalar_t p0 = a[0]*v[0][0] + a[1]*v[0][1] + a[2]*v[0][2];
+        scalar_t p1 = a[0]*v[1][0] + a[1]*v[1][1] + a[2]*v[1][2];
+        scalar_t p2 = a[0]*v[2][0] + a[1]*v[2][1] + a[2]*v[2][2];
+        scalar_t r = h[0]*fabs(a[0]) + h[1]*fabs(a[1]) + h[2]*fabs(a[2]);
+        return std::min({p0, p1, p2}) > r || std::max({p0, p1, p2}) < -r;
+    };
+
+    // plane of the triangle is the cheapest and the most selective axis for slivers
+    Vector3D n = plane_.n_vec();
+    scalar_t n_axis[3] = {n.x(), n.y(), n.z()};
+    if (separates(n_axis))
+        return false;
+
+    // normals of the box faces
+    for (int axis = 0; axis < 3; axis++)
+    {
+        scalar_t a[3] = {0, 0, 0};
+        a[axis] = 1;
+        if (separates(a))
+            return false;
+    }
+
+    // cross products of the box axes and the triangle edges
+    for (int i = 0; i < 3; i++)
+    {
+        const scalar_t *from = v[i], *to = v[(i + 1) % 3];
+        scalar_t e[3] = {to[0] - from[0], to[1] - from[1], to[2] - from[2]};
+        scalar_t axes[3][3] = {{0, -e[2], e[1]}, {e[2], 0, -e[0]}, {-e[1], e[0], 0}};
+        for (auto &a : axes)
+            if (separates(a))
+                return false;
+    }
+
+    return true;
+}
+
 bool BoundingBox::intersects(const BoundingBox &other) const
 {
     if (!leq(min_x_, other.max_x_) || !leq(other.min_x_, max_x_) )
@@ -0,0 +1,99 @@
+#include "triangles_c.h"
+#include "flat_api.hpp"
+
+#include <string>
+#include <new>
+#include <type_traits>
+
+namespace
+{
+
+static_assert(std::is_same_v<Driver::index_t, size_t>, "C API writes indices as size_t");
+
+thread_local std::string last_error;
+
+template <typename F>
+tri_status_t guarded(F &&f)
+{
+    try
+    {
+        last_error.clear();
+        f();
+        return TRI_OK;
+    }
+    catch (const Driver::Flat::WrongBuffer &e)
+    {
+        last_error = e.what();
+        return TRI_WRONG_ARGS;
+    }
+    catch (const Geom::GeomException &e)
+    {
+        last_error = e.what();
+        return TRI_WRONG_INPUT;
+    }
+    catch (const std::exception &e)
+    {
+        last_error = e.what();
+        return TRI_ERROR;
+    }
+    catch (...)
+    {
+        last_error = "Unknown error";
+        return TRI_ERROR;
+    }
+}
+
+template <typename T>
+tri_status_t indices(const T *coords, size_t count, size_t stride, size_t *out, size_t capacity, size_t *n_out)
+{
+    return guarded([&]()
+    {
+        if (!n_out || (capacity && !out))
+            throw Driver::Flat::WrongBuffer("no output buffer");
+        *n_out = Driver::Flat::get_inds_with_intscs(Driver::Flat::ShapeBuffer<T>{coords, count, stride},
+                                                    out, capacity);
+    });
+}
+
+template <typename T>
+tri_status_t pairs(const T *coords, size_t count, size_t stride, size_t *out, size_t capacity, size_t *n_out)
+{
+    return guarded([&]()
+    {
+        if (!n_out || (capacity && !out))
+            throw Driver::Flat::WrongBuffer("no output buffer");
+        *n_out = Driver::Flat::get_pairs_with_intscs(Driver::Flat::ShapeBuffer<T>{coords, count, stride},
+                                                     out, capacity);
+    });
+}
+
+} // anonymous namespace
+
+tri_status_t tri_intersecting_indices_d(const double *coords, size_t count, size_t stride,
+                                        size_t *out, size_t capacity, size_t *n_out)
+{
+    return indices(coords, count, stride, out, capacity, n_out);
+}
+
+tri_status_t tri_intersecting_indices_f(const float *coords, size_t count, size_t stride,
+                                        size_t *out, size_t capacity, size_t *n_out)
+{
+    return indices(coords, count, stride, out, capacity, n_out);
+}
+
+tri_status_t tri_intersecting_pairs_d(const double *coords, size_t count, size_t stride,
+                                      size_t *out, size_t capacity, size_t *n_out)
+{
+    return pairs(coords, count, stride, out, capacity, n_out);
+}
+
+tri_status_t tri_intersecting_pairs_f(const float *coords, size_t count, size_t stride,
+                                      size_t *out, size_t capacity, size_t *n_out)
+{
+    return pairs(coords, count, stride, out, capacity, n_out);
+}
+
+const char *tri_last_error(void)
+{
+    return last_error.c_str();
+}
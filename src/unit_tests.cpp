@@ -1,8 +1,18 @@
 #include <gtest/gtest.h>
 #include <cmath>
 #include <numeric>
+#include <random>
+#include <vector>
+#include <algorithm>
 
 #include "triangles.hpp"
+#include "lbvh.hpp"
+#include "verify.hpp"
+#include "scene_file.hpp"
+
+#include <sstream>
+#include <fstream>
+#include <cstdio>
 
 // USED TO GET ACCESS TO 'inline' FUNCTIONS IN THIS FILE
 #include "triangles.cpp"
@@ -417,6 +427,16 @@ TEST(LineSeg3D, IntersectsLineSeg3D)
 
     EXPECT_TRUE((LineSeg3D{Point3D{0,0,0},Point3D{1,0,0}}
     .intersects_LineSeg3D({Point3D{0,1,0},Point3D{0.5,-1,0}})));
+
+    // lines cross on the first segment, but not on the second one
+    EXPECT_FALSE((LineSeg3D{Point3D{0,-1,0},Point3D{0,1,0}}
+    .intersects_LineSeg3D({Point3D{1,0,0},Point3D{2,0,0}})));
+    EXPECT_FALSE((LineSeg3D{Point3D{8,12,13.5},Point3D{1,8,19.5}}
+    .intersects_LineSeg3D({Point3D{10,9,18},Point3D{16.5,8,19.5}})));
+
+    // start of the second segment is on the line of the first one, outside of it
+    EXPECT_FALSE((LineSeg3D{Point3D{9,30,19},Point3D{3,30,19}}
+    .intersects_LineSeg3D({Point3D{13,30,19},Point3D{20,23,16}})));
 }
 
 TEST(Plane, CtorOk)
@@ -644,6 +664,62 @@ TEST(Triangle3D, IntersectsTriangle3D)
 
 }
 
+TEST(Triangle3D, IntersectsBoundingBox)
+{
+    // diagonal sliver: boxes overlap, but the plane of the triangle misses the box
+    Triangle3D sliver{{0, 0, 0}, {10, 10, 10}, {10, 10.1, 10}};
+    BoundingBox box{Point3D{8, 0, 0}, Point3D{10, 2, 2}};
+    EXPECT_TRUE(sliver.bound_box().intersects(box));
+    EXPECT_FALSE(sliver.intersects_BoundingBox(box));
+
+    // the plane crosses the box, but an edge axis separates them
+    Triangle3D tr{{0, 0, 0}, {4, 0, 0}, {0, 4, 0}};
+    EXPECT_FALSE(tr.intersects_BoundingBox(BoundingBox{Point3D{2.5, 2.5, -1}, Point3D{3, 3, 1}}));
+    EXPECT_TRUE(tr.intersects_BoundingBox(BoundingBox{Point3D{1.5, 1.5, -1}, Point3D{3, 3, 1}}));
+
+    // vertex inside, box inside, touching
+    EXPECT_TRUE(tr.intersects_BoundingBox(BoundingBox{Point3D{-1, -1, -1}, Point3D{1, 1, 1}}));
+    EXPECT_TRUE(tr.intersects_BoundingBox(BoundingBox{Point3D{0.5, 0.5, 0}, Point3D{1, 1, 0}}));
+    EXPECT_TRUE(tr.intersects_BoundingBox(BoundingBox{Point3D{2, 2, 0}, Point3D{3, 3, 1}}));
+
+    // margin
+    BoundingBox above{Point3D{1, 1, 0.5}, Point3D{2, 2, 1}};
+    EXPECT_FALSE(tr.intersects_BoundingBox(above));
+    EXPECT_TRUE(tr.intersects_BoundingBox(above, 0.5));
+}
+
+TEST(KDop, Intersects)
+{
+    // parallel diagonal segments: boxes overlap, an edge diagonal separates them
+    LineSeg3D ls1{Point3D{0, 0, 0}, Point3D{2, 2, 0}}, ls2{Point3D{1, 0, 0}, Point3D{3, 2, 0}};
+    EXPECT_TRUE(ls1.bound_box().intersects(ls2.bound_box()));
+    EXPECT_FALSE(ls1.kdop<18>().intersects(ls2.kdop<18>()));
+    EXPECT_TRUE(ls1.kdop<6>().intersects(ls2.kdop<6>()));
+
+    // touching and crossing
+    LineSeg3D ls3{Point3D{2, 2, 0}, Point3D{3, 3, 1}}, ls4{Point3D{0, 2, 0}, Point3D{2, 0, 0}};
+    EXPECT_TRUE(ls1.kdop<18>().intersects(ls3.kdop<18>()));
+    EXPECT_TRUE(ls1.kdop<18>().intersects(ls4.kdop<18>()));
+
+    // diagonal sliver and a point inside its box
+    Triangle3D sliver{{0, 0, 0}, {10, 10, 10}, {10, 10.1, 10}};
+    EXPECT_FALSE(sliver.kdop<18>().intersects(DOP18{Point3D{8, 2, 2}}));
+    EXPECT_FALSE(sliver.kdop<14>().intersects(KDop<14>{Point3D{8, 2, 2}}));
+}
+
+TEST(KDop, Expand)
+{
+    DOP18 dop{Point3D{0, 0, 0}};
+    dop.expand(DOP18{Point3D{2, 4, 6}});
+    EXPECT_EQ(dop.min(), (Point3D{0, 0, 0}));
+    EXPECT_EQ(dop.max(), (Point3D{2, 4, 6}));
+    EXPECT_EQ(dop.center(), (Point3D{1, 2, 3}));
+
+    // expanded volume contains both points, but not the corner of their box off the diagonal planes
+    EXPECT_TRUE(dop.intersects(DOP18{Point3D{1, 2, 3}}));
+    EXPECT_FALSE(dop.intersects(DOP18{Point3D{2, 0, 0}}));
+}
+
 TEST(BoundingBox, Intersects)
 {
     // https://www.desmos.com/3d/taxvrz4rog
@@ -673,4 +749,246 @@ TEST(BoundingBox, Intersects)
 
     EXPECT_TRUE((BoundingBox{{0, 0, 0}, {1, 1, 1}}
      .intersects(BoundingBox{{-1, 0.5, -1}, {2, 0.7, 2}})));
-}
\ No newline at end of file
+}
+
+TEST(BoundingBox, MinMaxCenter)
+{
+    BoundingBox box{{1, 5, -3}, {4, 2, 6}, {2, 3, 0}};
+
+    EXPECT_TRUE((box.min() == Point3D{1, 2, -3}));
+    EXPECT_TRUE((box.max() == Point3D{4, 5, 6}));
+    EXPECT_TRUE((box.center() == Point3D{2.5, 3.5, 1.5}));
+}
+
+TEST(BoundingBox, Expand)
+{
+    BoundingBox box{{0, 0, 0}, {1, 1, 1}};
+    box.expand(BoundingBox{{2, -1, 0.5}});
+
+    EXPECT_TRUE((box.min() == Point3D{0, -1, 0}));
+    EXPECT_TRUE((box.max() == Point3D{2, 1, 1}));
+    EXPECT_TRUE(box.intersects(BoundingBox{{2, -1, 0.5}}));
+}
+
+TEST(CompactShapes, Full)
+{
+    Triangle3D tr{{1, 2, 3}, {4, 0, 1}, {0, 5, 2}};
+    CompactTriangle3D<double> ctr{tr};
+    EXPECT_TRUE((ctr.full().p1() == tr.p1() && ctr.full().p3() == tr.p3()));
+    EXPECT_TRUE((ctr.full().plane() == tr.plane()));
+    EXPECT_TRUE((ctr.bound_box().min() == tr.bound_box().min()));
+    EXPECT_TRUE((ctr.bound_box().max() == tr.bound_box().max()));
+    EXPECT_TRUE(CompactTriangle3D<float>{tr}.full().intersects_Triangle3D(tr));
+
+    LineSeg3D ls{Point3D{0, 0, 0}, Point3D{1, 2, 3}};
+    EXPECT_TRUE((CompactLineSeg3D<double>{ls}.full().vec() == ls.vec()));
+    EXPECT_TRUE((CompactLineSeg3D<float>{ls}.p2() == ls.p2()));
+
+    EXPECT_LT(sizeof(CompactTriangle3D<double>), sizeof(Triangle3D));
+    EXPECT_LT(sizeof(CompactLineSeg3D<float>), sizeof(CompactLineSeg3D<double>));
+}
+
+TEST(CompactShapes, DegenerateInFloat)
+{
+    LineSeg3D ls{Point3D{1, 1, 1}, Point3D{1 + 1e-9, 1, 1}};
+    EXPECT_NO_THROW((CompactLineSeg3D<double>{ls}));
+    EXPECT_THROW((CompactLineSeg3D<float>{ls}), LineSeg3D::DegeneratedLineSeg);
+
+    Triangle3D tr{{1, 1, 1}, {1 + 1e-9, 1, 1}, {1, 2, 1}};
+    EXPECT_THROW((CompactTriangle3D<float>{tr}), Triangle3D::DegeneratedTriangle);
+}
+
+TEST(LBVH, QueryInterleavedMatchesQuery)
+{
+    // enough leaves for query_interleaved to take its interleaved path, not the one by one fallback
+    const size_t N_BOXES = (1 << 16) + 4096, N_QUERIES = 2000;
+    std::mt19937 gen{42};
+    std::uniform_real_distribution<double> coord{0, 100}, size{0, 0.5};
+    auto random_box = [&](double max_size)
+    {
+        Point3D lo{coord(gen), coord(gen), coord(gen)};
+        double dx = size(gen) * max_size, dy = size(gen) * max_size, dz = size(gen) * max_size;
+        return BoundingBox{lo, Point3D{lo.x() + dx, lo.y() + dy, lo.z() + dz}};
+    };
+
+    std::vector<BoundingBox> boxes;
+    for (size_t i = 0; i < N_BOXES; i++)
+        boxes.push_back(random_box(1));
+    std::vector<BoundingBox> queries;
+    for (size_t i = 0; i < N_QUERIES; i++)
+        queries.push_back(random_box(16));
+    Driver::LBVH bvh{boxes};
+
+    std::vector<std::vector<size_t>> expected(N_QUERIES), got(N_QUERIES);
+    size_t n_found = 0;
+    for (size_t query = 0; query < N_QUERIES; query++)
+    {
+        bvh.query(queries[query], [&](size_t leaf) {expected[query].push_back(leaf);});
+        std::sort(expected[query].begin(), expected[query].end());
+        n_found += expected[query].size();
+    }
+    bvh.query_interleaved(N_QUERIES, [&](size_t query) {return queries[query];},
+                          [&](size_t query, size_t leaf) {got[query].push_back(leaf);});
+
+    EXPECT_GT(n_found, N_QUERIES);
+    for (size_t query = 0; query < N_QUERIES; query++)
+    {
+        std::sort(got[query].begin(), got[query].end());
+        EXPECT_EQ(got[query], expected[query]) << "query " << query;
+    }
+}
+
+namespace
+{
+
+// shapes 0 and 1 intersect, shape 2 is far from them
+const std::vector<double> VERIFY_INP = {0, 0, 0, 1, 0, 0, 0, 1, 0,
+                                        0.25, 0.25, -1, 0.25, 0.25, 1, 0.5, 0.5, 1,
+                                        5, 5, 5, 6, 5, 5, 5, 6, 5};
+
+} // anonymous namespace
+
+TEST(Verify, NoMismatches)
+{
+    Driver::Verify::Report report = Driver::Verify::verify(VERIFY_INP, Driver::Engine::LBVH);
+    EXPECT_EQ(report.n_shapes, 3u);
+    EXPECT_EQ(report.n_checked, 3u);
+    EXPECT_TRUE(report.mismatches.empty());
+    EXPECT_FALSE(report.engine_error);
+}
+
+TEST(Verify, MismatchesWithRepro)
+{
+    using Driver::index_t;
+
+    // reports shape 2 as well
+    auto extra = [](const Driver::ShapeArray &arr)
+    {
+        std::set<index_t> inds = Driver::get_inds_with_intscs(arr);
+        for (auto ind : arr.inds)
+            if (ind == 2)
+                inds.insert(ind);
+        return inds;
+    };
+    Driver::Verify::Report report = Driver::Verify::verify(VERIFY_INP, extra);
+    ASSERT_EQ(report.mismatches.size(), 1u);
+    EXPECT_EQ(report.mismatches[0].ind, 2u);
+    EXPECT_TRUE(report.mismatches[0].by_engine);
+    EXPECT_EQ(report.mismatches[0].repro, std::make_pair(index_t{0}, index_t{2}));
+
+    // finds nothing
+    auto none = [](const Driver::ShapeArray &) {return std::set<index_t>{};};
+    report = Driver::Verify::verify(VERIFY_INP, none, Driver::Verify::Params{20000, 1, 1});
+    ASSERT_EQ(report.mismatches.size(), 2u);
+    EXPECT_EQ(report.mismatches[0].ind, 0u);
+    EXPECT_FALSE(report.mismatches[0].by_engine);
+    EXPECT_EQ(report.mismatches[0].repro, std::make_pair(index_t{0}, index_t{1}));
+    EXPECT_EQ(report.mismatches[1].ind, 1u);
+    EXPECT_FALSE(report.mismatches[1].repro); // beyond max_repros
+}
+
+TEST(Verify, EngineError)
+{
+    auto failing = [](const Driver::ShapeArray &) -> std::set<Driver::index_t>
+    {
+        throw std::runtime_error("engine failed");
+    };
+    Driver::Verify::Report report = Driver::Verify::verify(VERIFY_INP, failing);
+    ASSERT_TRUE(report.engine_error);
+    EXPECT_EQ(*report.engine_error, "engine failed");
+    EXPECT_TRUE(report.mismatches.empty());
+}
+
+TEST(Verify, WritePairInput)
+{
+    std::ostringstream out;
+    Driver::Verify::write_pair_input(out, VERIFY_INP, {0, 2});
+    EXPECT_EQ(out.str(), "2\n0 0 0  1 0 0  0 1 0\n5 5 5  6 5 5  5 6 5\n");
+
+    // numbers are written exactly
+    std::vector<double> inp = VERIFY_INP;
+    inp[9] = 0.1;
+    inp[17] = 1.0 / 3;
+    out.str("");
+    Driver::Verify::write_pair_input(out, inp, {0, 1});
+
+    std::istringstream in{out.str()};
+    int n = 0;
+    in >> n;
+    EXPECT_EQ(n, 2);
+    for (size_t k = 0; k < 18; k++)
+    {
+        double coord = 0;
+        in >> coord;
+        EXPECT_EQ(coord, inp[k]) << "coordinate " << k;
+    }
+}
+
+namespace
+{
+
+// overwrites size bytes of the file at offset with the given byte
+void overwrite(const std::string &filename, uint64_t offset, size_t size, char byte)
+{
+    std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(offset);
+    std::string bytes(size, byte);
+    file.write(bytes.data(), size);
+}
+
+} // anonymous namespace
+
+TEST(SceneFile, CorruptedPayload)
+{
+    using Driver::SceneFile::Header;
+    using Driver::SceneFile::Mapped;
+    using Driver::SceneFile::WrongSceneFile;
+
+    std::mt19937 gen{7};
+    std::uniform_real_distribution<double> coord{0, 10}, offset{0, 1};
+    Driver::ListPoint3D points;
+    Driver::ListLineSeg3D linesegs;
+    Driver::ListTriangle3D triangles;
+    for (Driver::index_t ind = 0; ind < 200; ind++)
+    {
+        Point3D p{coord(gen), coord(gen), coord(gen)};
+        triangles.emplace_back(ind, Triangle3D{p, Point3D{p.x() + offset(gen), p.y(), p.z()},
+                                               Point3D{p.x(), p.y() + offset(gen), p.z() + offset(gen)}});
+    }
+
+    const std::string filename = testing::TempDir() + "corrupted.scene";
+    auto save = [&]()
+    {
+        Driver::SceneFile::save(filename, 0, points, linesegs, triangles);
+        return Mapped{filename}.header();
+    };
+
+    Header hdr = save();
+    EXPECT_EQ(hdr.n_shapes(), 200u);
+
+    // a leaf item out of range
+    overwrite(filename, hdr.lbvh_leaf_items_offset + 5 * sizeof(uint32_t), sizeof(uint32_t), '\x7f');
+    EXPECT_THROW(Mapped{filename}, WrongSceneFile);
+
+    // children of the LBVH root out of range, then pointing back to the root
+    hdr = save();
+    overwrite(filename, hdr.lbvh_nodes_offset + offsetof(Driver::LBVH::Node, left), sizeof(uint32_t), '\x7f');
+    EXPECT_THROW(Mapped{filename}, WrongSceneFile);
+    hdr = save();
+    overwrite(filename, hdr.lbvh_nodes_offset + offsetof(Driver::LBVH::Node, right), sizeof(uint32_t), 0);
+    EXPECT_THROW(Mapped{filename}, WrongSceneFile);
+
+    // a child of the BVH8 root out of range
+    hdr = save();
+    overwrite(filename, hdr.bvh8_nodes_offset + offsetof(Driver::BVH8::Node, child), sizeof(uint32_t), '\x7f');
+    EXPECT_THROW(Mapped{filename}, WrongSceneFile);
+
+    // a shape of no kind
+    hdr = save();
+    overwrite(filename, hdr.shapes_offset, sizeof(Driver::Shape), '\xff');
+    EXPECT_THROW(Mapped{filename}, WrongSceneFile);
+
+    save();
+    EXPECT_NO_THROW(Mapped{filename});
+    std::remove(filename.c_str());
+}
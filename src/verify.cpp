@@ -0,0 +1,122 @@
+#include "verify.hpp"
+
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+namespace Driver
+{
+
+namespace Verify
+{
+
+namespace
+{
+
+ShapeArray sample_array(const std::vector<double> &inp, const std::vector<index_t> &shapes)
+{
+    ListPoint3D points;
+    ListLineSeg3D linesegs;
+    ListTriangle3D triangles;
+    for (auto ind : shapes)
+        parse_shape(ind, &inp[9 * ind], points, linesegs, triangles);
+    return make_shape_array(points, linesegs, triangles);
+}
+
+// another shape of the sample, such that the engines disagree on the scene of these two shapes
+// (or the engine fails on it)
+std::optional<std::pair<index_t, index_t>> find_repro(const std::vector<double> &inp,
+                                                      const std::vector<index_t> &sample,
+                                                      index_t ind, const Finder &engine)
+{
+    for (auto other : sample)
+    {
+        if (other == ind)
+            continue;
+        std::vector<index_t> pair{std::min(ind, other), std::max(ind, other)};
+        ShapeArray arr = sample_array(inp, pair);
+        std::set<index_t> by_brute = get_inds_with_intscs(arr);
+        bool agree = false;
+        try
+        {
+            agree = engine(arr) == by_brute;
+        }
+        catch (const std::exception &) {}
+        if (!agree)
+            return std::make_pair(pair[0], pair[1]);
+    }
+    return std::nullopt;
+}
+
+} // anonymous namespace
+
+Report verify(const std::vector<double> &inp, const Finder &engine, const Params &params)
+{
+    Report report;
+    report.n_shapes = inp.size() / 9;
+
+    std::vector<index_t> sample(report.n_shapes);
+    std::iota(sample.begin(), sample.end(), 0);
+    if (sample.size() > params.sample)
+    {
+        std::mt19937_64 rng{params.seed};
+        std::vector<index_t> picked;
+        picked.reserve(params.sample);
+        std::sample(sample.begin(), sample.end(), std::back_inserter(picked), params.sample, rng);
+        sample.swap(picked);
+    }
+    report.n_checked = sample.size();
+
+    ShapeArray arr = sample_array(inp, sample);
+    std::set<index_t> by_brute = get_inds_with_intscs(arr), by_engine;
+    try
+    {
+        by_engine = engine(arr);
+    }
+    catch (const std::exception &e)
+    {
+        report.engine_error = e.what();
+        return report;
+    }
+
+    std::vector<index_t> only_engine, only_brute;
+    std::set_difference(by_engine.begin(), by_engine.end(), by_brute.begin(), by_brute.end(),
+                        std::back_inserter(only_engine));
+    std::set_difference(by_brute.begin(), by_brute.end(), by_engine.begin(), by_engine.end(),
+                        std::back_inserter(only_brute));
+
+    for (auto ind : only_engine)
+        report.mismatches.push_back(Mismatch{ind, true, std::nullopt});
+    for (auto ind : only_brute)
+        report.mismatches.push_back(Mismatch{ind, false, std::nullopt});
+    std::sort(report.mismatches.begin(), report.mismatches.end(),
+              [](const Mismatch &a, const Mismatch &b) {return a.ind < b.ind;});
+
+    for (size_t k = 0; k < std::min(params.max_repros, report.mismatches.size()); k++)
+        report.mismatches[k].repro = find_repro(inp, sample, report.mismatches[k].ind, engine);
+
+    return report;
+}
+
+Report verify(const std::vector<double> &inp, Engine engine, const Params &params)
+{
+    return verify(inp, [engine](const ShapeArray &arr) {return get_inds_with_intscs(arr, engine);}, params);
+}
+
+void write_pair_input(std::ostream &out, const std::vector<double> &inp, std::pair<index_t, index_t> pair)
+{
+    auto precision = out.precision(std::numeric_limits<double>::max_digits10);
+    out << 2 << '\n';
+    for (auto ind : {pair.first, pair.second})
+    {
+        for (size_t k = 0; k < 9; k++)
+            out << inp[9 * ind + k] << ((k % 3 == 2) ? (k == 8 ? "\n" : "  ") : " ");
+    }
+    out.precision(precision);
+}
+
+} // namespace Verify
+
+} // namespace Driver